@@ -0,0 +1,35 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * The table core with a ROM recompiled ahead of time by romc.c.
+ *
+ * This file is sim1a.c plus the generated aot_rom.inc, so the op_*
+ * functions the blocks call are inlined into them. The blocks are
+ * only used while the ROM loaded is the image they were compiled
+ * from; anything else, and any PC that is not the start of a known
+ * block, runs in the interpreter. native.c decides when a block may
+ * run.
+ *
+ * Select it with "make CORE=aot", and the ROM with AOT_ROM=file.
+ */
+
+#define WANT_NATIVE
+#include <string.h>
+#include "sim1a.c"
+#include "aot_rom.inc"
+
+static CPU_LOCAL int aot_gen = -1;
+static CPU_LOCAL int aot_ok;		/* the loaded ROM is rom_image[] */
+
+const struct native_block *native_block(WORD adr, op_func *op_sim)
+{
+	if (aot_gen != rom_gen) {
+		aot_gen = rom_gen;
+		aot_ok = !memcmp(ram, rom_image, sizeof(rom_image));
+	}
+	if (!aot_ok || adr >= sizeof(rom_image) || !rom_blocks[adr].code)
+		return(NULL);
+	return(&rom_blocks[adr]);
+}
@@ -0,0 +1,365 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * Basic block translator from 8080 to x86-64 for the table core.
+ *
+ * A block starts at a ROM address and runs up to and including the
+ * first jump, call, return, RST or PCHL, see opcodes.h; native.c
+ * decides when a block may run. Register moves, MVI, LXI, INX/DCX,
+ * XCHG, NOP, JMP and the conditional jumps are emitted inline; every
+ * other opcode is a call of its op_* function from sim1a.c, so the
+ * flag quirks and memwrt() are shared with the interpreter.
+ *
+ * Only the basic ROM is translated: memwrt() keeps it from changing,
+ * so the translations stay valid until rom_gen says a new image was
+ * loaded. While the history is on the interpreter runs everything.
+ *
+ * Select it with "make CORE=jit".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "opcodes.h"
+#include "native.h"
+
+#if !defined(__x86_64__)
+#error "jit.c emits x86-64 code"
+#endif
+#if !defined(WANT_TIM)
+#error "jit.c needs WANT_TIM"
+#endif
+
+#define JIT_CODESIZE	(1024 * 1024)	/* bytes of generated code */
+#define JIT_MAXOPCODE	96		/* bytes emitted for one opcode */
+
+/*
+ * code NULL: not translated yet, n 0: left to the interpreter. The
+ * code has the addresses of the registers and of the ram pointer of
+ * its thread built in, so each thread has its own buffer, unmapped by
+ * jit_free() when the thread ends. ram itself is loaded as the code
+ * runs, so the blocks serve every machine with the same ROM image
+ * that the thread runs. The buffer is never writable and executable
+ * at once: the pages of a block are made writable while it is emitted.
+ */
+static CPU_LOCAL struct native_block jit_map[ROM_TOP];
+static CPU_LOCAL BYTE *jit_buf, *jit_top, *jit_end;
+static CPU_LOCAL int jit_gen = -1;
+static CPU_LOCAL int jit_off;		/* no code buffer */
+static CPU_LOCAL BYTE *jp;		/* emit pointer */
+static pthread_key_t jit_key;
+static pthread_once_t jit_once = PTHREAD_ONCE_INIT;
+
+/*
+ *	Pseudo code for blocks which are left to the interpreter.
+ */
+static int jit_none(void)
+{
+	return(0);
+}
+
+static void jit_flush(void)
+{
+	memset(jit_map, 0, sizeof(jit_map));
+	jit_top = jit_buf;
+	jit_gen = rom_gen;
+}
+
+static void jit_free(void *buf)
+{
+	munmap(buf, JIT_CODESIZE);
+}
+
+static void jit_key_create(void)
+{
+	pthread_key_create(&jit_key, jit_free);
+}
+
+static int jit_alloc(void)
+{
+	pthread_once(&jit_once, jit_key_create);
+	jit_buf = mmap(NULL, JIT_CODESIZE, PROT_READ | PROT_EXEC,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit_buf == MAP_FAILED) {
+		jit_buf = NULL;
+		return(0);
+	}
+	pthread_setspecific(jit_key, jit_buf);
+	jit_end = jit_buf + JIT_CODESIZE;
+	jit_flush();
+	return(1);
+}
+
+/*
+ *	Set the protection of the pages holding from .. to-1.
+ */
+static int jit_protect(BYTE *from, BYTE *to, int prot)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t lo = (uintptr_t) from & ~(page - 1);
+
+	return(mprotect((void *) lo, (uintptr_t) to - lo, prot) == 0);
+}
+
+/*
+ *	x86-64 code emitters. All registers used (eax, ecx) are
+ *	caller saved, globals are addressed with 64 bit absolute
+ *	addresses, so the code buffer can live anywhere.
+ */
+static void emit1(unsigned b)
+{
+	*jp++ = b;
+}
+
+static void emit4(uint32_t v)
+{
+	memcpy(jp, &v, 4);
+	jp += 4;
+}
+
+static void emit8(uint64_t v)
+{
+	memcpy(jp, &v, 8);
+	jp += 8;
+}
+
+static void ld_al(BYTE *p)		/* mov al,[p] */
+{
+	emit1(0xa0);
+	emit8((uintptr_t) p);
+}
+
+static void st_al(BYTE *p)		/* mov [p],al */
+{
+	emit1(0xa2);
+	emit8((uintptr_t) p);
+}
+
+static void mov_al(BYTE v)		/* mov al,v */
+{
+	emit1(0xb0);
+	emit1(v);
+}
+
+static void ld_pair(BYTE *hi, BYTE *lo)	/* eax = hi << 8 | lo */
+{
+	emit1(0x31); emit1(0xc0);	/* xor eax,eax */
+	ld_al(hi);
+	emit1(0xc1); emit1(0xe0); emit1(8); /* shl eax,8 */
+	ld_al(lo);
+}
+
+static void ld_ram_rcx(void)		/* rcx = ram */
+{
+	emit1(0x48); emit1(0xb9);	/* mov rcx,&ram */
+	emit8((uintptr_t) &ram);
+	emit1(0x48); emit1(0x8b); emit1(0x09); /* mov rcx,[rcx] */
+}
+
+static void st_pc(void)			/* PC = ram + rax */
+{
+	ld_ram_rcx();
+	emit1(0x48); emit1(0x01); emit1(0xc8); /* add rax,rcx */
+	emit1(0x48); emit1(0xa3);	/* mov [PC],rax */
+	emit8((uintptr_t) &PC);
+}
+
+static void set_pc(WORD adr)		/* PC = ram + adr */
+{
+	emit1(0xb8);			/* mov eax,adr */
+	emit4(adr);
+	st_pc();
+}
+
+static void call_op(op_func fn)	/* eax = fn() */
+{
+	emit1(0x48); emit1(0xb8);	/* mov rax,fn */
+	emit8((uintptr_t) fn);
+	emit1(0xff); emit1(0xd0);	/* call rax */
+}
+
+static void ret_eax(void)
+{
+	emit1(0x48); emit1(0x83); emit1(0xc4); emit1(8); /* add rsp,8 */
+	emit1(0xc3);			/* ret */
+}
+
+/*
+ *	Emit the code of one opcode inline, if it is one of the simple
+ *	ones. Returns 0 if a call of the op_* function is needed.
+ */
+static int emit_inline(WORD adr, BYTE op)
+{
+	BYTE *const reg8[8] = { &B, &C, &D, &E, &H, &L, NULL, &A };
+	BYTE *d = reg8[(op >> 3) & 7], *s = reg8[op & 7];
+	WORD nn = ram[adr + 1] | (ram[adr + 2] << 8);
+	BYTE *const hi[3] = { &B, &D, &H };
+	BYTE *const lo[3] = { &C, &E, &L };
+	static const BYTE mask[4] = { Z_FLAG, C_FLAG, P_FLAG, S_FLAG };
+
+	if (op == 0x00)					/* NOP */
+		return(1);
+	if (op >= 0x40 && op < 0x80 && d != NULL) {
+		if (s == NULL) {			/* MOV r,M */
+			ld_pair(&H, &L);
+			ld_ram_rcx();
+			emit1(0x8a); emit1(0x04); emit1(0x01); /* mov al,[rcx+rax] */
+		} else if (s != d) {			/* MOV r,r */
+			ld_al(s);
+		} else
+			return(1);
+		st_al(d);
+		return(1);
+	}
+	if ((op & 0xc7) == 0x06 && d != NULL) {		/* MVI r,n */
+		mov_al(ram[adr + 1]);
+		st_al(d);
+		return(1);
+	}
+	if ((op & 0xcf) == 0x01 && op != 0x31) {	/* LXI rp,nn */
+		mov_al(nn & 0xff);
+		st_al(lo[op >> 4]);
+		mov_al(nn >> 8);
+		st_al(hi[op >> 4]);
+		return(1);
+	}
+	if (((op & 0xcf) == 0x03 || (op & 0xcf) == 0x0b) && op < 0x30) {
+		ld_pair(hi[op >> 4], lo[op >> 4]);	/* INX/DCX rp */
+		emit1(0xff); emit1(op & 8 ? 0xc8 : 0xc0); /* dec/inc eax */
+		st_al(lo[op >> 4]);
+		emit1(0xc1); emit1(0xe8); emit1(8); /* shr eax,8 */
+		st_al(hi[op >> 4]);
+		return(1);
+	}
+	if (op == 0xeb) {				/* XCHG */
+		ld_al(&D);
+		emit1(0x88); emit1(0xc1);	/* mov cl,al */
+		ld_al(&H);
+		st_al(&D);
+		emit1(0x88); emit1(0xc8);	/* mov al,cl */
+		st_al(&H);
+		ld_al(&E);
+		emit1(0x88); emit1(0xc1);
+		ld_al(&L);
+		st_al(&E);
+		emit1(0x88); emit1(0xc8);
+		st_al(&L);
+		return(1);
+	}
+	if (op == 0xc3) {				/* JMP nn */
+		set_pc(nn);
+		return(1);
+	}
+	if ((op & 0xc7) == 0xc2) {			/* Jcc nn */
+		emit1(0xa1);			/* mov eax,[F] */
+		emit8((uintptr_t) &F);
+		emit1(0xa8);			/* test al,mask */
+		emit1(mask[(op >> 4) & 3]);
+		emit1(0xb8);			/* mov eax,nn */
+		emit4(nn);
+		emit1(0xb9);			/* mov ecx,adr+3 */
+		emit4(adr + 3);
+		emit1(0x0f);			/* cmovz/cmovnz eax,ecx */
+		emit1(op & 8 ? 0x44 : 0x45);
+		emit1(0xc1);
+		st_pc();
+		return(1);
+	}
+	return(0);
+}
+
+/*
+ *	Translate the block starting at adr. The generated function
+ *	returns the T-states of the whole block and leaves PC at the
+ *	next opcode to execute.
+ */
+static void jit_translate(struct native_block *b, WORD adr,
+			  op_func *op_sim)
+{
+	BYTE op, *lim;
+	int n = 0, sum = 0, last = 0, jump = 0, inl;
+
+	if (jit_end - jit_top < JIT_MAXOPCODE * (NATIVE_MAXOPS + 2))
+		jit_flush();
+	lim = jit_top + JIT_MAXOPCODE * (NATIVE_MAXOPS + 2);
+	if (!jit_protect(jit_top, lim, PROT_READ | PROT_WRITE)) {
+		b->code = jit_none;
+		b->n = 0;
+		return;
+	}
+	jp = jit_top;
+	emit1(0x48); emit1(0x83); emit1(0xec); emit1(8); /* sub rsp,8 */
+	while (n < NATIVE_MAXOPS) {
+		op = ram[adr];
+		if (blk_stop(op) || adr + oplen[op] > ROM_TOP)
+			break;
+		n++;
+		jump = blk_jump(op);
+		inl = emit_inline(adr, op);
+		if (!inl) {
+			if (jump || oplen[op] > 1)
+				set_pc(adr + 1);
+			call_op(op_sim[op]);
+		}
+		if (jump) {
+			if (inl) {			/* JMP, Jcc: 10 */
+				emit1(0xb8);	/* mov eax,sum+10 */
+				emit4(sum + cycles[op]);
+			} else {
+				emit1(0x05);	/* add eax,sum */
+				emit4(sum);
+			}
+			break;
+		}
+		last = cycles[op];
+		sum += last;
+		adr += oplen[op];
+	}
+	if (n == 0) {
+		jit_protect(jit_top, lim, PROT_READ | PROT_EXEC);
+		b->code = jit_none;
+		b->n = 0;
+		return;
+	}
+	if (!jump) {
+		set_pc(adr);
+		emit1(0xb8);			/* mov eax,sum */
+		emit4(sum);
+		sum -= last;
+	}
+	ret_eax();
+	if (!jit_protect(jit_top, lim, PROT_READ | PROT_EXEC)) {
+		b->code = jit_none;
+		b->n = 0;
+		return;
+	}
+	b->code = (int (*)(void)) jit_top;
+	b->n = n;
+	b->pre = sum;
+	jit_top = jp;
+}
+
+const struct native_block *native_block(WORD adr, op_func *op_sim)
+{
+	struct native_block *b;
+
+	if (jit_buf == NULL && (jit_off || !jit_alloc())) {
+		jit_off = 1;
+		return(NULL);
+	}
+	if (jit_gen != rom_gen)
+		jit_flush();
+	b = &jit_map[adr];
+	if (b->code == NULL)
+		jit_translate(b, adr, op_sim);
+	return(b->n ? b : NULL);
+}
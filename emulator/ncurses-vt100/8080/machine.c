@@ -0,0 +1,114 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * Machines, see machine.h.
+ *
+ * Moving a machine in or out copies some 500 bytes; the tables
+ * (ram[], brk_map[], dirty[], the history) stay where they are and
+ * only their pointers move. A caller runs a machine for a slice
+ * between the two, or like the simulator keeps its only machine
+ * entered all along.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "machine.h"
+
+/*
+ *	A new machine with empty memory and no ROM, its devices
+ *	reached through io. NULL if there is no room for it.
+ */
+struct machine *machine_new(const struct cpu_io *io)
+{
+	struct machine *m;
+
+	if ((m = calloc(1, sizeof(struct machine))) == NULL)
+		return(NULL);
+	m->ram = mem_map();
+	m->brk_map = calloc(65536, 1);
+#ifdef WANT_DIRTY
+	m->dirty = calloc(DIRTY_SIZE, 1);
+	if (m->dirty == NULL) {
+		machine_free(m);
+		return(NULL);
+	}
+#endif
+	if (m->ram == NULL || m->brk_map == NULL) {
+		machine_free(m);
+		return(NULL);
+	}
+	m->wrk_ram = m->pc = m->ram;
+	m->sp = m->ram + 0xffff;
+	m->t_start = m->t_end = m->ram + 65535;
+	m->t_limit = ~0ULL;
+	m->cpu_state = STOPPED;
+	m->io = *io;
+	return(m);
+}
+
+void machine_free(struct machine *m)
+{
+	if (m->ram != NULL)
+		mem_unmap(m->ram);
+	free(m->brk_map);
+	free(m->dirty);
+#ifdef HISIZE
+	free(m->his);
+#endif
+	free(m);
+}
+
+/*
+ *	Copy the state of m into the CPU_LOCAL variables (in != 0) or
+ *	back.
+ */
+static void machine_move(struct machine *m, int in)
+{
+#define MV(var, fld)	if (in) var = m->fld; else m->fld = var
+#define MVA(var, fld)	if (in) memcpy(var, m->fld, sizeof(m->fld)); \
+			else memcpy(m->fld, var, sizeof(m->fld))
+
+	MV(A, a); MV(B, b); MV(C, c); MV(D, d); MV(E, e);
+	MV(H, h); MV(L, l); MV(F, f); MV(I, i); MV(IFF, iff); MV(R, r);
+	MV(PC, pc); MV(STACK, sp); MV(io_port, io_port);
+	MV(ram, ram); MV(wrk_ram, wrk_ram); MV(brk_map, brk_map);
+#ifdef WANT_DIRTY
+	MV(dirty, dirty);
+#endif
+	MVA(mem_page, mem_page);
+	MV(brk_on, brk_on); MV(rom_gen, rom_gen);
+	MVA(mem_log, mem_log); MVA(mem_log_old, mem_log_old);
+	MV(mem_logged, mem_logged);
+#ifdef HISIZE
+	MV(his, his); MV(h_mask, h_mask); MV(h_next, h_next);
+#endif
+	MV(t_states, t_states); MV(t_flag, t_flag);
+	MV(t_start, t_start); MV(t_end, t_end);
+	MV(t_ticks, t_ticks); MV(t_limit, t_limit);
+	MV(cpu_state, cpu_state); MV(int_data, int_data);
+	MV(cpu_error, cpu_error); MV(int_nmi, int_nmi);
+	MV(int_int, int_int); MV(int_mode, int_mode);
+	MV(int_protection, int_protection); MV(cpu_halt, cpu_halt);
+	MV(cpu_io, io);
+
+#undef MV
+#undef MVA
+}
+
+/*
+ *	The thread runs m from now on, until machine_leave(m).
+ */
+void machine_enter(struct machine *m)
+{
+	machine_move(m, 1);
+}
+
+void machine_leave(struct machine *m)
+{
+	machine_move(m, 0);
+}
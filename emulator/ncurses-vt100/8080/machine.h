@@ -0,0 +1,47 @@
+/*
+ *	A machine: the state of one 8080 with its memory and the
+ *	devices it talks to, so that a process can run more than one.
+ *
+ *	The cores work on the CPU_LOCAL variables of simglb.c, at the
+ *	speed of plain globals. A thread runs a machine by moving it
+ *	into them with machine_enter() and out again with
+ *	machine_leave(); in between the registers, ram[], the
+ *	breakpoints, the history and the clock are those of the
+ *	machine. The options and flags of simglb.c (i_flag, tmax, ...)
+ *	belong to the thread.
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+struct machine {
+	BYTE	a, b, c, d, e, h, l, i, iff, io_port;
+	int	f;
+	long	r;
+	BYTE	*pc, *sp;
+	BYTE	*ram, *wrk_ram, *brk_map, *dirty;
+	BYTE	mem_page[256];
+	int	brk_on, rom_gen;
+	WORD	mem_log[MEMLOG];
+	BYTE	mem_log_old[MEMLOG];
+	int	mem_logged;
+#ifdef HISIZE
+	struct history *his;
+	unsigned long h_mask, h_next;
+#endif
+	long	t_states;
+	int	t_flag;
+	BYTE	*t_start, *t_end;
+	unsigned long long t_ticks, t_limit;
+	BYTE	cpu_state, int_data;
+	int	cpu_error, int_nmi, int_int, int_mode, int_protection,
+		cpu_halt;
+	struct cpu_io io;
+};
+
+struct machine *machine_new(const struct cpu_io *io);
+void machine_free(struct machine *m);
+void machine_enter(struct machine *m);
+void machine_leave(struct machine *m);
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * The 64KB address space of the 8080.
+ *
+ * ram[] is mapped three times in a row from the same memory file:
+ * ram[-65536] to ram[-1] and ram[65536] to ram[131071] are the very
+ * same bytes as ram[0] to ram[65535]. A PC or STACK pointer run off
+ * either end, or an operand read across 0xffff, so still sees the
+ * right bytes without a check, and sim1a.c leaves out those of
+ * WANT_PCC and WANT_SPC. cpu_8080() brings PC and STACK back into
+ * ram[0..65535] on return; a slice is far too short for them to get
+ * further than one mirror away. Stores go through memwrt() with a
+ * WORD address and never see the mirrors.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+
+#define	MEM_SIZE	65536
+
+/*
+ *	The ROM images loaded by all machines, each with its number.
+ */
+struct rom_image {
+	struct rom_image *next;
+	int	gen;
+	BYTE	image[ROM_TOP];
+};
+
+static struct rom_image *rom_images;
+static int rom_gens;		/* numbers given out */
+static pthread_mutex_t rom_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *	Map a ram[] and its mirrors, NULL with errno set if that
+ *	cannot be done.
+ */
+BYTE *mem_map(void)
+{
+	BYTE *p;
+	int fd, i;
+
+	if ((fd = memfd_create("8080 ram", 0)) < 0)
+		return(NULL);
+	if (ftruncate(fd, MEM_SIZE) < 0) {
+		close(fd);
+		return(NULL);
+	}
+	p = mmap(NULL, 3 * MEM_SIZE, PROT_NONE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	for (i = 0; p != MAP_FAILED && i < 3; i++)
+		if (mmap(p + i * MEM_SIZE, MEM_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			munmap(p, 3 * MEM_SIZE);
+			p = MAP_FAILED;
+		}
+	close(fd);
+	return(p == MAP_FAILED ? NULL : p + MEM_SIZE);
+}
+
+void mem_unmap(BYTE *p)
+{
+	munmap(p - MEM_SIZE, 3 * MEM_SIZE);
+}
+
+/*
+ *	A ROM image is in ram[]: number it, so that the caches built
+ *	from the ROM (sim1b.c, jit.c, aot.c), which are per thread, see
+ *	the change whichever machine a thread runs. Machines with the
+ *	same image share its number, so a farm thread going from one to
+ *	the next keeps its caches.
+ */
+void mem_rom_loaded(void)
+{
+	struct rom_image *r;
+
+	pthread_mutex_lock(&rom_lock);
+	for (r = rom_images; r != NULL; r = r->next)
+		if (!memcmp(r->image, ram, ROM_TOP))
+			break;
+	if (r == NULL && (r = malloc(sizeof(*r))) != NULL) {
+		memcpy(r->image, ram, ROM_TOP);
+		r->gen = ++rom_gens;
+		r->next = rom_images;
+		rom_images = r;
+	}
+	rom_gen = r != NULL ? r->gen : ++rom_gens;
+	pthread_mutex_unlock(&rom_lock);
+}
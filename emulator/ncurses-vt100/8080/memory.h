@@ -0,0 +1,58 @@
+/*
+ *	Memory model of the VT100: every store of the 8080 cores goes
+ *	through memwrt(), so that the basic ROM stays read only, the
+ *	front end learns which bytes were written (in dirty[], a bit
+ *	per byte, if built WANT_DIRTY) and the first MEMLOG
+ *	changes since mem_logged was last cleared are journaled with
+ *	the old values (see Vt100Sim::idleCheck()).
+ *
+ *	mem_page[] gives the kind of each 256 byte page: plain RAM,
+ *	ROM, watched (cpu_io.mem_hook() sees the store, then it is
+ *	done, or dropped for watched ROM) or memory mapped I/O (only
+ *	cpu_io.mem_hook() sees it).
+ *	A store to plain RAM costs one lookup. Loads are not hooked,
+ *	the VT100 has its I/O on ports.
+ *
+ *	ram[] itself and its mirrors are set up by mem_map(), see
+ *	memory.c.
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#define	ROM_TOP		0x2000		/* 0x0000-0x1fff is the basic ROM */
+
+#ifdef WANT_DIRTY
+#define	DIRTY_SIZE	(65536 / 8)
+#define	mem_dirty(a)	(dirty[(WORD) (a) >> 3] & (1 << ((a) & 7)))
+#endif
+
+BYTE *mem_map(void);			/* see memory.c */
+void mem_unmap(BYTE *p);
+void mem_rom_loaded(void);
+
+static inline void memwrt(WORD addr, BYTE data)
+{
+	BYTE kind = mem_page[addr >> 8];
+
+	if (kind != MEM_RAM) {
+		if (kind == MEM_ROM)	/* writes to ROM are ignored */
+			return;
+		cpu_io.mem_hook(cpu_io.ctx, addr, data);
+		if (kind != MEM_WATCH)	/* MMIO or watched ROM */
+			return;
+	}
+	if (ram[addr] != data) {
+		if (mem_logged < MEMLOG) {
+			mem_log[mem_logged] = addr;
+			mem_log_old[mem_logged++] = ram[addr];
+		} else
+			mem_logged = MEMLOG + 1;	/* overflowed */
+		ram[addr] = data;
+	}
+#ifdef WANT_DIRTY
+	dirty[addr >> 3] |= 1 << (addr & 7);
+#endif
+}
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * Glue between cpu_8080() and the native cores (jit.c, aot.c).
+ *
+ * A native block is only entered where the interpreter would have
+ * run all its opcodes without anything else happening in between:
+ * in CONTIN_RUN, with room for the whole block left in the slice,
+ * and not while an interrupt is pending and enabled, in which case
+ * the interpreter runs one opcode at a time so that the interrupt
+ * is taken exactly where it would be taken without native code.
+ * The blocks themselves never contain I/O or EI/DI (see blk_stop()
+ * in opcodes.h).
+ *
+ * Built with NATIVE_VERIFY (make NATIVE_VERIFY=1) every block is
+ * first run by the interpreter on the same state and the results
+ * are compared; any difference is reported on stderr and the
+ * simulator aborts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "native.h"
+
+#if !defined(WANT_TIM)
+#error "native.c needs WANT_TIM"
+#endif
+
+#ifdef NATIVE_VERIFY
+struct native_regs {
+	BYTE	a, b, c, d, e, h, l, iff;
+	int	f;
+	BYTE	*pc, *sp;
+};
+
+static CPU_LOCAL BYTE v_ram[65536], i_ram[65536];
+#ifdef WANT_DIRTY
+static CPU_LOCAL BYTE v_dirty[DIRTY_SIZE], i_dirty[DIRTY_SIZE];
+#else
+static BYTE dirty[1], v_dirty[1], i_dirty[1];	/* nothing to compare */
+#endif
+
+static void get_regs(struct native_regs *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->a = A; r->b = B; r->c = C; r->d = D;
+	r->e = E; r->h = H; r->l = L; r->iff = IFF;
+	r->f = F; r->pc = PC; r->sp = STACK;
+}
+
+static void set_regs(struct native_regs *r)
+{
+	A = r->a; B = r->b; C = r->c; D = r->d;
+	E = r->e; H = r->h; L = r->l; IFF = r->iff;
+	F = r->f; PC = r->pc; STACK = r->sp;
+}
+
+static void print_regs(const char *s, struct native_regs *r, int states)
+{
+	fprintf(stderr, "%s: PC %04x SP %04x A %02x F %02x BC %02x%02x "
+		"DE %02x%02x HL %02x%02x IFF %d T %d\n", s,
+		(int) (r->pc - ram), (int) (r->sp - ram), r->a, r->f,
+		r->b, r->c, r->d, r->e, r->h, r->l, r->iff, states);
+}
+
+/*
+ *	Run the block in the interpreter, then again from the same
+ *	state as native code, and compare registers, T-states and
+ *	memory.
+ */
+static int native_verify(const struct native_block *b, op_func *op_sim)
+{
+	struct native_regs pre, interp, native;
+	WORD trace[NATIVE_MAXOPS];
+	int i, states = 0, jstates;
+
+	get_regs(&pre);
+	memcpy(v_ram, ram, sizeof(v_ram));
+	memcpy(v_dirty, dirty, sizeof(v_dirty));
+	for (i = 0; i < b->n; i++) {
+		trace[i] = PC - ram;
+		states += (*op_sim[*PC++]) ();
+	}
+	get_regs(&interp);
+	memcpy(i_ram, ram, sizeof(i_ram));
+	memcpy(i_dirty, dirty, sizeof(i_dirty));
+
+	set_regs(&pre);
+	memcpy(ram, v_ram, sizeof(v_ram));
+	memcpy(dirty, v_dirty, sizeof(v_dirty));
+	jstates = b->code();
+	get_regs(&native);
+
+	if (states != jstates || memcmp(&interp, &native, sizeof(native))
+	    || memcmp(ram, i_ram, sizeof(i_ram))
+	    || memcmp(dirty, i_dirty, sizeof(i_dirty))) {
+		fprintf(stderr, "native: block at %04x differs from the "
+			"interpreter\n", trace[0]);
+		for (i = 0; i < b->n; i++)
+			fprintf(stderr, "  %04x  %02x\n", trace[i],
+				ram[trace[i]]);
+		print_regs("before", &pre, 0);
+		print_regs("interp", &interp, states);
+		print_regs("native", &native, jstates);
+		for (i = 0; i < 65536; i++)
+			if (ram[i] != i_ram[i])
+				fprintf(stderr, "  %04x: interp %02x "
+					"native %02x\n", i, i_ram[i], ram[i]);
+		for (i = 0; i < (int) sizeof(i_dirty); i++)
+			if (dirty[i] != i_dirty[i])
+				fprintf(stderr, "  %04x: written interp %02x "
+					"native %02x\n", i * 8, i_dirty[i],
+					dirty[i]);
+		abort();
+	}
+	return(jstates);
+}
+#endif
+
+/*
+ *	Called by cpu_8080() in place of one opcode. Runs the block
+ *	at PC, and the blocks following it as long as the slice has
+ *	room for them, and returns their T-states, with R advanced by
+ *	all but one of their opcodes. Returns 0 if the interpreter has
+ *	to execute the next opcode.
+ */
+int native_run(op_func *op_sim)
+{
+	const struct native_block *b;
+	int states = 0;
+
+	if (cpu_state != CONTIN_RUN || t_flag || t_start < ram + ROM_TOP
+	    || brk_on)			/* blocks do not stop at breakpoints */
+		return(0);
+#ifdef HISIZE
+	if (his != NULL)		/* nor write history */
+		return(0);
+#endif
+	if (int_int && IFF == 3)	/* taken after the next opcode (EI) */
+		return(0);
+	while (PC < ram + ROM_TOP
+	       && (b = native_block(PC - ram, op_sim)) != NULL
+	       && t_ticks + states + b->pre < t_limit) {
+		R += b->n;
+#ifdef NATIVE_VERIFY
+		states += native_verify(b, op_sim);
+#else
+		states += b->code();
+#endif
+	}
+	if (states)
+		R--;
+	return(states);
+}
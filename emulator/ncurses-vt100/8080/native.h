@@ -0,0 +1,27 @@
+/*
+ *	Interface between cpu_8080() in sim1a.c and the cores which
+ *	run basic blocks of the ROM as native code: the translator in
+ *	jit.c and the recompiled ROM of aot.c.
+ */
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#define NATIVE_MAXOPS	32		/* longest block in opcodes */
+
+struct native_block {
+	int	(*code)(void);		/* returns the T-states taken */
+	WORD	n;			/* number of opcodes */
+	WORD	pre;			/* T-states before the last opcode */
+};
+
+/* sim1a.c op_* functions, indexed by opcode */
+typedef int (*op_func)(void);
+
+/* native.c: run the block at PC, 0 if the interpreter must do it */
+extern int native_run(op_func *);
+
+/* jit.c or aot.c: the block starting at adr, or NULL */
+extern const struct native_block *native_block(WORD, op_func *);
+
+#endif
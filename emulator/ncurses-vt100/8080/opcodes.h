@@ -0,0 +1,74 @@
+/*
+ *	Opcode tables shared by the 8080 cores that do not get the
+ *	length and timing of an opcode from its op_* function.
+ */
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+/*
+ *	T-states of every opcode. The conditional calls and returns
+ *	take 6 more when the condition is met.
+ */
+static const BYTE cycles[256] = {
+	 4, 10,  7,  5,  5,  5,  7,  4,  0, 10,  7,  5,  5,  5,  7,  4,	/* 0x00 */
+	 0, 10,  7,  5,  5,  5,  7,  4,  0, 10,  7,  5,  5,  5,  7,  4,	/* 0x10 */
+	 0, 10, 16,  5,  5,  5,  7,  4,  0, 10, 16,  5,  5,  5,  7,  4,	/* 0x20 */
+	 0, 10, 13,  5, 10, 10, 10,  4,  0, 10, 13,  5,  5,  5,  7,  4,	/* 0x30 */
+	 5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,	/* 0x40 */
+	 5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,	/* 0x50 */
+	 5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,	/* 0x60 */
+	 7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5,	/* 0x70 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 0x80 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 0x90 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 0xa0 */
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,	/* 0xb0 */
+	 5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10,  0, 11, 17,  7, 11,	/* 0xc0 */
+	 5, 10, 10, 10, 11, 11,  7, 11,  5,  0, 10, 10, 11,  0,  7, 11,	/* 0xd0 */
+	 5, 10, 10, 18, 11, 11,  7, 11,  5,  5, 10,  4, 11,  0,  7, 11,	/* 0xe0 */
+	 5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11,  0,  7, 11	/* 0xf0 */
+};
+
+/*
+ *	Length of every opcode in bytes
+ */
+static const BYTE oplen[256] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,
+	1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, 1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, 1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 1, 2, 1,
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1
+};
+
+/*
+ *	Opcodes which end a basic block after them (jumps, calls,
+ *	returns, RST, PCHL), and opcodes which the native cores leave
+ *	to the interpreter, so a block ends before them (HLT, EI, DI,
+ *	IN, OUT and the illegal opcodes).
+ */
+static inline int blk_jump(BYTE op)
+{
+	if (op == 0xc3 || op == 0xc9 || op == 0xcd || op == 0xe9)
+		return(1);
+	if ((op & 0xc0) != 0xc0 || cycles[op] == 0)
+		return(0);
+	switch (op & 7) {
+	case 0:				/* Rcc */
+	case 2:				/* Jcc */
+	case 4:				/* Ccc */
+	case 7:				/* RST */
+		return(1);
+	}
+	return(0);
+}
+
+static inline int blk_stop(BYTE op)
+{
+	return(cycles[op] == 0 || op == 0x76 || op == 0xfb || op == 0xf3
+	       || op == 0xdb || op == 0xd3);
+}
+
+#endif
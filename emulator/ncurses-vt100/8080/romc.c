@@ -0,0 +1,239 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * romc: static recompiler of a VT100 ROM image into C for aot.c.
+ *
+ *	romc rom.bin sim1a.c > aot_rom.inc
+ *
+ * Starting at the reset and RST vectors it follows every jump, call
+ * and return address it can see and writes one C function per basic
+ * block, plus a table of the blocks by address and a copy of the
+ * image. Blocks are cut like those of jit.c (see opcodes.h). Every
+ * opcode of a block becomes a call of its op_* function of sim1a.c,
+ * which the compiler inlines since aot.c includes sim1a.c; the
+ * names are read from the op_sim[] table of sim1a.c so they cannot
+ * get out of step. JMP, Jcc, MVI and LXI with their operands known
+ * here are written out directly.
+ *
+ * Code only reached through PCHL or a return address pushed by the
+ * program itself is not found; there cpu_8080() interprets until it
+ * reaches the start of a known block again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "opcodes.h"
+#include "native.h"
+
+static BYTE rom[ROM_TOP];
+static int rom_size;
+static char op_name[256][16];
+static BYTE is_start[ROM_TOP], done[ROM_TOP];
+static WORD todo[ROM_TOP];
+static int ntodo;
+
+static const char *const reg[8] = { "B", "C", "D", "E", "H", "L", "M", "A" };
+static const char *const cond[8] = {
+	"!(F & Z_FLAG)", "(F & Z_FLAG)", "!(F & C_FLAG)", "(F & C_FLAG)",
+	"!(F & P_FLAG)", "(F & P_FLAG)", "!(F & S_FLAG)", "(F & S_FLAG)"
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: romc rom.bin sim1a.c\n");
+	exit(1);
+}
+
+static void read_rom(const char *fn)
+{
+	FILE *fp;
+
+	if ((fp = fopen(fn, "rb")) == NULL) {
+		perror(fn);
+		exit(1);
+	}
+	rom_size = fread(rom, 1, sizeof(rom), fp);
+	fclose(fp);
+	if (rom_size <= 0) {
+		fprintf(stderr, "romc: %s is empty\n", fn);
+		exit(1);
+	}
+}
+
+/*
+ *	Collect the names of the op_* functions from the initializer
+ *	of op_sim[] in sim1a.c.
+ */
+static void read_ops(const char *fn)
+{
+	FILE *fp;
+	char line[256], *p;
+	int n = 0, in_table = 0, i;
+
+	if ((fp = fopen(fn, "r")) == NULL) {
+		perror(fn);
+		exit(1);
+	}
+	while (n < 256 && fgets(line, sizeof(line), fp) != NULL) {
+		if (!in_table) {
+			in_table = strstr(line, "op_sim[256]") != NULL;
+			continue;
+		}
+		if ((p = strstr(line, "op_")) == NULL)
+			continue;
+		for (i = 0; i < 15 && (isalnum((unsigned char) p[i])
+				       || p[i] == '_'); i++)
+			op_name[n][i] = p[i];
+		op_name[n++][i] = '\0';
+	}
+	fclose(fp);
+	if (n != 256) {
+		fprintf(stderr, "romc: found %d op_* functions in %s\n",
+			n, fn);
+		exit(1);
+	}
+}
+
+static void add(int adr)
+{
+	if (adr >= 0 && adr < rom_size && !is_start[adr]) {
+		is_start[adr] = 1;
+		todo[ntodo++] = adr;
+	}
+}
+
+/*
+ *	Decode the block at adr and queue every address execution can
+ *	continue at after it.
+ */
+static void follow(int adr)
+{
+	int n = 0;
+	BYTE op;
+	WORD nn;
+
+	while (n < NATIVE_MAXOPS && adr < rom_size) {
+		op = rom[adr];
+		if (blk_stop(op)) {
+			if (cycles[op] != 0)	/* interpreted, then go on */
+				add(adr + oplen[op]);
+			return;
+		}
+		if (adr + oplen[op] > rom_size)
+			return;
+		n++;
+		nn = rom[(adr + 1) % ROM_TOP] | (rom[(adr + 2) % ROM_TOP] << 8);
+		if (blk_jump(op)) {
+			if (op == 0xc3 || (op & 0xc7) == 0xc2	/* JMP, Jcc */
+			    || op == 0xcd || (op & 0xc7) == 0xc4) /* CALL, Ccc */
+				add(nn);
+			if ((op & 0xc7) == 0xc7)		/* RST */
+				add(op & 0x38);
+			if (op != 0xc3 && op != 0xc9 && op != 0xe9)
+				add(adr + oplen[op]);
+			return;
+		}
+		adr += oplen[op];
+	}
+	add(adr);
+}
+
+/*
+ *	Write the function for the block at adr and return its number
+ *	of opcodes and the T-states before the last one.
+ */
+static int emit_block(int adr, int *pre)
+{
+	int n = 0, sum = 0, last = 0, jump = 0;
+	BYTE op;
+	WORD nn;
+
+	printf("static int rom_%04x(void)\n{\n\tregister int t = 0;\n\n", adr);
+	while (n < NATIVE_MAXOPS && adr < rom_size) {
+		op = rom[adr];
+		if (blk_stop(op) || adr + oplen[op] > rom_size)
+			break;
+		n++;
+		nn = rom[(adr + 1) % ROM_TOP] | (rom[(adr + 2) % ROM_TOP] << 8);
+		jump = blk_jump(op);
+		printf("\t/* %04x: %02x */ ", adr, op);
+		if (op == 0xc3)
+			printf("PC = ram + 0x%04x; t += %d;\n", nn, cycles[op]);
+		else if ((op & 0xc7) == 0xc2)
+			printf("PC = ram + (%s ? 0x%04x : 0x%04x); t += %d;\n",
+			       cond[(op >> 3) & 7], nn, adr + 3, cycles[op]);
+		else if ((op & 0xc7) == 0x06 && op != 0x36)
+			printf("%s = 0x%02x; t += %d;\n", reg[(op >> 3) & 7],
+			       nn & 0xff, cycles[op]);
+		else if ((op & 0xcf) == 0x01 && op != 0x31)
+			printf("%s = 0x%02x; %s = 0x%02x; t += %d;\n",
+			       reg[(op >> 3) + 1], nn & 0xff, reg[op >> 3],
+			       nn >> 8, cycles[op]);
+		else if (jump || oplen[op] > 1)
+			printf("PC = ram + 0x%04x; t += %s();\n", adr + 1,
+			       op_name[op]);
+		else
+			printf("t += %s();\n", op_name[op]);
+		if (jump)
+			break;
+		last = cycles[op];
+		sum += last;
+		adr += oplen[op];
+	}
+	if (!jump) {
+		printf("\tPC = ram + 0x%04x;\n", adr);
+		sum -= last;
+	}
+	printf("\treturn(t);\n}\n\n");
+	*pre = sum;
+	return(n);
+}
+
+int main(int argc, char *argv[])
+{
+	static int nops[ROM_TOP], pre[ROM_TOP];
+	int i, adr, blocks = 0;
+
+	if (argc != 3)
+		usage();
+	read_rom(argv[1]);
+	read_ops(argv[2]);
+	for (i = 0; i < 8; i++)
+		add(i * 8);
+	while (ntodo > 0) {
+		adr = todo[--ntodo];
+		if (!done[adr]) {
+			done[adr] = 1;
+			follow(adr);
+		}
+	}
+
+	printf("/* Generated by romc from %s, do not edit */\n\n", argv[1]);
+	printf("static const BYTE rom_image[%d] = {", rom_size);
+	for (i = 0; i < rom_size; i++)
+		printf("%s0x%02x,", i % 12 ? " " : "\n\t", rom[i]);
+	printf("\n};\n\n");
+	for (adr = 0; adr < rom_size; adr++) {
+		if (!is_start[adr] || blk_stop(rom[adr])
+		    || adr + oplen[rom[adr]] > rom_size)
+			continue;
+		nops[adr] = emit_block(adr, &pre[adr]);
+		blocks++;
+	}
+	printf("static const struct native_block rom_blocks[%d] = {\n",
+	       rom_size);
+	for (adr = 0; adr < rom_size; adr++)
+		if (nops[adr])
+			printf("\t[0x%04x] = { rom_%04x, %d, %d },\n", adr,
+			       adr, nops[adr], pre[adr]);
+	printf("};\n");
+	fprintf(stderr, "romc: %d blocks\n", blocks);
+	return(0);
+}
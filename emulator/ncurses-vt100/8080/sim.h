@@ -43,13 +43,18 @@
 #define WANT_INT	/* activate CPU's interrupts */
 #define WANT_SPC	/* activate SP over-/underrun handling 0000<->FFFF */
 #define WANT_PCC	/* activate PC overrun handling FFFF->0000 */
+			/* (sim1a.c gets both from the mirrors of ram[]) */
 #define	CNTL_C		/* cntl-c will stop running emulation */
 #define	CNTL_BS		/* cntl-\ will stop running emulation */
 #define	WANT_TIM	/* activate runtime measurement */
-#define	HISIZE	100	/* number of entries in history */
+#define	HISIZE	65536	/* default entries in history, if switched on */
 #define	SBSIZE	4	/* number of software breakpoints */
+#define	MEMLOG	64	/* number of RAM changes journaled */
+/*#define WANT_DIRTY*/	/* track the bytes written, for the memory window */
+			/* (set by the Makefile for vt100sim only) */
 /*#define FRONTPANEL*/	/* no frontpanel emulation */
 /*#define BUS_8080*/	/* no emulation of 8080 bus status */
+#define	CPU_LOCAL __thread /* CPU state per thread, see machine.c */
 
 /*
  *	Default CPU
@@ -99,6 +104,16 @@
 #define	CONTIN_RUN	1		/* continual run */
 #define	STOPPED		0		/* stop CPU because of error */
 
+					/* flags in brk_map[] */
+#define	BRK_EXEC	1		/* stop before the opcode here */
+
+					/* kinds of pages in mem_page[] */
+#define	MEM_RAM		0		/* plain RAM */
+#define	MEM_ROM		1		/* stores are ignored */
+#define	MEM_WATCH	2		/* stores are shown mem_hook() first */
+#define	MEM_MMIO	3		/* stores only go to mem_hook() */
+#define	MEM_ROM_WATCH	4		/* shown mem_hook(), then ignored */
+
 					/* causes of error */
 #define	NONE		0		/* no error */
 #define	OPHALT		1		/* HALT	op-code	trap */
@@ -115,6 +130,13 @@
 typedef	unsigned short WORD;		/* 16 bit unsigned */
 typedef	unsigned char  BYTE;		/* 8 bit unsigned */
 
+struct cpu_io {				/* the devices of a machine */
+	BYTE	(*in)(void *ctx, BYTE port);		/* IN */
+	void	(*out)(void *ctx, BYTE port, BYTE data); /* OUT */
+	void	(*mem_hook)(void *ctx, WORD addr, BYTE data); /* memory.h */
+	void	*ctx;			/* passed to all three */
+};
+
 #ifdef HISIZE
 struct history {			/* structure of a history entry */
 	WORD	h_adr;			/* address of execution */
@@ -122,8 +144,6 @@ struct history {			/* structure of a history entry */
 	WORD	h_bc;			/* register BC */
 	WORD	h_de;			/* register DE */
 	WORD	h_hl;			/* register HL */
-	WORD	h_ix;			/* register IX */
-	WORD	h_iy;			/* register IY */
 	WORD	h_sp;			/* register SP */
 };
 #endif
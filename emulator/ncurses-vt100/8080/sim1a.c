@@ -31,14 +31,16 @@
  * 04-JUN-14 Release 1.23 added 8080 emulation
  */
 
-#include <ncurses.h>
-extern WINDOW* msgWin;
-
 #include <unistd.h>
 #include <stdio.h>
 #include <time.h>
 #include "sim.h"
 #include "simglb.h"
+#include "memory.h"
+
+/* PC and SP wrap by themselves in the mirrors of ram[], see memory.c */
+#undef WANT_PCC
+#undef WANT_SPC
 
 #ifdef FRONTPANEL
 #include "../../frontpanel/frontpanel.h"
@@ -48,6 +50,10 @@ extern WINDOW* msgWin;
 void check_gui_break(void);
 #endif
 
+#ifdef WANT_NATIVE
+#include "native.h"
+#endif
+
 static int op_trap(void), op_nop(void), op_hlt(void), op_stc(void);
 static int op_cmc(void), op_cma(void), op_daa(void), op_ei(void), op_di(void);;
 static int op_out(void), op_in(void);
@@ -126,6 +132,17 @@ static int op_rst4(void), op_rst5(void), op_rst6(void), op_rst7(void);
  *	index to an array with function pointers, to execute a
  *	function which emulates this 8080 opcode.
  *
+ *	In CONTIN_RUN mode opcodes are executed until t_ticks
+ *	reaches t_limit, so the caller can hand out a budget of
+ *	cycles and service its devices once per slice. The run
+ *	also ends when PC gets to an address marked BRK_EXEC in
+ *	brk_map[].
+ *
+ *	Built with WANT_NATIVE (make CORE=jit or CORE=aot) whole
+ *	basic blocks of the ROM are run as native code, see native.c.
+ *
+ *	PC and STACK may stray into the mirrors of ram[] meanwhile,
+ *	they are brought back before returning.
  */
 void cpu_8080(void)
 {
@@ -390,10 +407,8 @@ void cpu_8080(void)
 
 #ifdef WANT_TIM
 	register int t = 0;
-	struct timespec timer;
-#ifdef FRONTPANEL
 	register int states;
-#endif
+	struct timespec timer;
 #endif
 
 	do {
@@ -413,17 +428,16 @@ void cpu_8080(void)
 		fp_sampleLightGroup(0, 0);
 #endif
 
-#ifdef HISIZE		/* write history */
-		his[h_next].h_adr = PC - ram;
-		his[h_next].h_af = (A << 8) + F;
-		his[h_next].h_bc = (B << 8) + C;
-		his[h_next].h_de = (D << 8) + E;
-		his[h_next].h_hl = (H << 8) + L;
-		his[h_next].h_sp = STACK - ram;
-		h_next++;
-		if (h_next == HISIZE) {
-			h_flag = 1;
-			h_next = 0;
+#ifdef HISIZE		/* write history, if switched on */
+		if (his != NULL) {
+			struct history *hp = &his[h_next++ & h_mask];
+
+			hp->h_adr = PC - ram;
+			hp->h_af = (A << 8) + F;
+			hp->h_bc = (B << 8) + C;
+			hp->h_de = (D << 8) + E;
+			hp->h_hl = (H << 8) + L;
+			hp->h_sp = STACK - ram;
 		}
 #endif
 
@@ -446,19 +460,23 @@ void cpu_8080(void)
 				goto leave;
 			}
 			IFF = 0;
+			if (cpu_halt) {	/* return behind the HLT */
+				cpu_halt = 0;
+				PC++;
+			}
 
 #ifdef WANT_SPC
 			if (STACK <= ram)
 				STACK =	ram + 65536L;
 #endif
-			*--STACK = (PC - ram) >> 8;
-			touched[STACK-ram] = 1;
+			--STACK;
+			memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 			if (STACK <= ram)
 				STACK =	ram + 65536L;
 #endif
-			*--STACK = (PC - ram);
-			touched[STACK-ram] = 1;
+			--STACK;
+			memwrt(STACK - ram, (PC - ram));
 			switch (int_data) {
 			case 0xc7: /* RST 00H */
 				PC = ram + 0;
@@ -494,12 +512,13 @@ leave:
 #endif
 
 #ifdef WANT_TIM
-#ifdef FRONTPANEL
+#ifdef WANT_NATIVE
+		if ((states = native_run(op_sim)) == 0) /* native block */
+#endif
 		states = (*op_sim[*PC++]) ();	/* execute next opcode */
 		t += states;
+#ifdef FRONTPANEL
 		fp_clock += states;
-#else
-		t += (*op_sim[*PC++]) ();
 #endif
 		if (f_flag) {		/* adjust CPU speed */
 			if (t > tmax) {
@@ -522,22 +541,32 @@ leave:
 
 #ifdef WANT_TIM				/* do runtime measurement */
 		if (t_flag) {
-			t_states += t;	/* add T-states for this opcode */
+			t_states += states; /* add T-states for this opcode */
 			if (PC == t_end) /* check for end address */
 				t_flag = 0; /* if reached, switch off */
 		}
-        t_ticks += t;
+		t_ticks += states;
 #endif
 
+		if (brk_map[(WORD) (PC - ram)] & BRK_EXEC) /* breakpoint ahead */
+			cpu_state = SINGLE_STEP;
+
 #ifdef WANT_GUI
                 check_gui_break();
 #endif
 
+#ifdef WANT_TIM
+	} while	(cpu_state == CONTIN_RUN && t_ticks < t_limit);
+#else
 	} while	(cpu_state == CONTIN_RUN);
+#endif
 
 #ifdef BUS_8080
 	cpu_bus = CPU_WO | CPU_M1 | CPU_MEMR;
 #endif
+
+	PC = ram + (WORD) (PC - ram);		/* back from the mirrors */
+	STACK = ram + (WORD) (STACK - ram);
 }
 
 /*
@@ -557,32 +586,32 @@ static int op_nop(void)                 /* NOP */
 
 static int op_hlt(void)			/* HLT */
 {
-	extern int busy_loop_cnt[];
-	struct timespec timer;
-
 #ifdef BUS_8080
 	cpu_bus = CPU_WO | CPU_HLTA | CPU_MEMR;
 #endif
 
+	busy_loop_cnt[0] = 0;
 #ifndef FRONTPANEL
 	if (IFF == 0)	{
 		cpu_error = OPHALT;
 		cpu_state = STOPPED;
-	} else
+		return(7);
+	}
 #endif
-		while ((int_int == 0) && (cpu_state == CONTIN_RUN)) {
-#ifdef FRONTPANEL
-			fp_clock += 4;
-			fp_sampleData();
+	/*
+	 * Interrupts are raised by the caller between slices or steps,
+	 * so the HLT is not waited out here. Stay on it and give the
+	 * rest of the slice away, the next event is the earliest an
+	 * interrupt can come; it resumes behind the HLT. The caller
+	 * advances the clock itself after a single step.
+	 */
+	PC--;
+	cpu_halt = 1;
+#ifdef WANT_TIM
+	if (cpu_state == CONTIN_RUN && !int_int && t_limit != ~0ULL &&
+	    t_limit > t_ticks + 7)
+		return(t_limit - t_ticks);
 #endif
-			timer.tv_sec = 0;
-			timer.tv_nsec = 1000000L;
-			nanosleep(&timer, NULL);
-			R += 9999;
-		}
-
-	busy_loop_cnt[0] = 0;
-
 	return(7);
 }
 
@@ -640,29 +669,25 @@ static int op_di(void)			/* DI */
 
 static int op_in(void)			/* IN n */
 {
-	BYTE io_in(BYTE);
-
 #ifdef BUS_8080
 	cpu_bus = CPU_WO | CPU_INP;
 #endif
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	A = io_in(*PC++);
+	A = cpu_io.in(cpu_io.ctx, *PC++);
 	return(10);
 }
 
 static int op_out(void)			/* OUT n */
 {
-	BYTE io_out(BYTE, BYTE);
-
 #ifdef BUS_8080
 	cpu_bus = CPU_OUT;
 #endif
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	io_out(*PC++, A);
+	cpu_io.out(cpu_io.ctx, *PC++, A);
 	return(10);
 }
 
@@ -798,8 +823,7 @@ static int op_staxb(void)		/* STAX B */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(B << 8) + C) =	A;
-	*(touched + (B << 8) + C) = 1;
+	memwrt((B << 8) + C, A);
 	return(7);
 }
 
@@ -811,8 +835,7 @@ static int op_staxd(void)		/* STAX D */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(D << 8) + E) =	A;
-	*(touched + (D << 8) + E) = 1;
+	memwrt((D << 8) + E, A);
 	return(7);
 }
 
@@ -828,8 +851,7 @@ static int op_stann(void)		/* STA nn */
 #endif
 	i = *PC++;
 	i += *PC++ << 8;
-	*(ram +	i) = A;
-	*(touched + i) = 1;
+	memwrt(i, A);
 	return(13);
 }
 
@@ -841,8 +863,7 @@ static int op_movma(void)		/* MOV M,A */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	A;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, A);
 	return(7);
 }
 
@@ -854,8 +875,7 @@ static int op_movmb(void)		/* MOV M,B */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	B;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, B);
 	return(7);
 }
 
@@ -867,8 +887,7 @@ static int op_movmc(void)		/* MOV M,C */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	C;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, C);
 	return(7);
 }
 
@@ -880,8 +899,7 @@ static int op_movmd(void)		/* MOV M,D */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	D;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, D);
 	return(7);
 }
 
@@ -893,8 +911,7 @@ static int op_movme(void)		/* MOV M,E */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	E;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, E);
 	return(7);
 }
 
@@ -906,8 +923,7 @@ static int op_movmh(void)		/* MOV M,H */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	H;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, H);
 	return(7);
 }
 
@@ -919,8 +935,7 @@ static int op_movml(void)		/* MOV M,L */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	L;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, L);
 	return(7);
 }
 
@@ -932,8 +947,7 @@ static int op_mvimn(void)		/* MVI M,n */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*(ram +	(H << 8) + L) =	*PC++;
-	*(touched + (H << 8) + L) = 1;
+	memwrt((H << 8) + L, *PC++);
 	return(10);
 }
 
@@ -1395,10 +1409,8 @@ static int op_shldnn(void)		/* SHLD nn */
 #endif
 	i = *PC++;
 	i += *PC++ << 8;
-	*(ram +	i) = L;
-	*(ram +	i + 1) = H;
-	*(touched + i) = 1;
-	*(touched + i + 1) = 1;
+	memwrt(i, L);
+	memwrt(i + 1, H);
 	return(16);
 }
 
@@ -2544,7 +2556,7 @@ static int op_inrl(void)		/* INR L */
 
 static int op_inrm(void)		/* INR M */
 {
-	register BYTE *p;
+	register BYTE i;
 
 #ifdef BUS_8080
 	cpu_bus = CPU_WO | CPU_MEMR;
@@ -2552,13 +2564,13 @@ static int op_inrm(void)		/* INR M */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	p = ram	+ (H <<	8) + L;
-	((*p & 0xf) + 1	> 0xf) ? (F |= H_FLAG) : (F &= ~H_FLAG);
-	(*p)++;
-	touched[p-ram] = 1;
-	(parity[*p]) ? (F &= ~P_FLAG) : (F |= P_FLAG);
-	(*p & 128) ? (F	|= S_FLAG) : (F	&= ~S_FLAG);
-	(*p) ? (F &= ~Z_FLAG) :	(F |= Z_FLAG);
+	i = *(ram + (H << 8) + L);
+	((i & 0xf) + 1 > 0xf) ? (F |= H_FLAG) : (F &= ~H_FLAG);
+	i++;
+	memwrt((H << 8) + L, i);
+	(parity[i]) ? (F &= ~P_FLAG) : (F |= P_FLAG);
+	(i & 128) ? (F |= S_FLAG) : (F &= ~S_FLAG);
+	(i) ? (F &= ~Z_FLAG) : (F |= Z_FLAG);
 	return(10);
 }
 
@@ -2634,7 +2646,7 @@ static int op_dcrl(void)		/* DCR L */
 
 static int op_dcrm(void)		/* DCR M */
 {
-	register BYTE *p;
+	register BYTE i;
 
 #ifdef BUS_8080
 	cpu_bus = CPU_WO | CPU_MEMR;
@@ -2642,13 +2654,13 @@ static int op_dcrm(void)		/* DCR M */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	p = ram	+ (H <<	8) + L;
-	(((*p - 1) & 0xf) == 0xf) ? (F |= H_FLAG) : (F &= ~H_FLAG);
-	touched[p-ram] = 1;
-	(*p)--;
-	(parity[*p]) ? (F &= ~P_FLAG) : (F |= P_FLAG);
-	(*p & 128) ? (F	|= S_FLAG) : (F	&= ~S_FLAG);
-	(*p) ? (F &= ~Z_FLAG) :	(F |= Z_FLAG);
+	i = *(ram + (H << 8) + L);
+	(((i - 1) & 0xf) == 0xf) ? (F |= H_FLAG) : (F &= ~H_FLAG);
+	i--;
+	memwrt((H << 8) + L, i);
+	(parity[i]) ? (F &= ~P_FLAG) : (F |= P_FLAG);
+	(i & 128) ? (F |= S_FLAG) : (F &= ~S_FLAG);
+	(i) ? (F &= ~Z_FLAG) : (F |= Z_FLAG);
 	return(10);
 }
 
@@ -2721,12 +2733,10 @@ static int op_xthl(void)		/* XTHL */
 	fp_sampleLightGroup(0, 0);
 #endif
 	i = *STACK;
-	*STACK = L;
-	touched[STACK-ram] = 1;
+	memwrt(STACK - ram, L);
 	L = i;
 	i = *(STACK + 1);
-	*(STACK	+ 1) = H;
-	touched[1+STACK-ram] = 1;
+	memwrt(STACK - ram + 1, H);
 	H = i;
 #ifdef BUS_8080
 	cpu_bus = CPU_STACK;
@@ -2749,14 +2759,14 @@ static int op_pushpsw(void)		/* PUSH PSW */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = A;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, A);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = F;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, F);
 	return(11);
 }
 
@@ -2772,14 +2782,14 @@ static int op_pushb(void)		/* PUSH B */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = B;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, B);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = C;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, C);
 	return(11);
 }
 
@@ -2795,14 +2805,14 @@ static int op_pushd(void)		/* PUSH D */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = D;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, D);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = E;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, E);
 	return(11);
 }
 
@@ -2818,14 +2828,14 @@ static int op_pushh(void)		/* PUSH H */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = H;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, H);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = L;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, L);
 	return(11);
 }
 
@@ -2958,14 +2968,14 @@ static int op_call(void)		/* CALL */
 #ifdef FRONTPANEL
 	fp_sampleLightGroup(0, 0);
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + i;
 	return(17);
 }
@@ -3163,14 +3173,14 @@ static int op_cz(void)			/* CZ nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_STACK;
 #endif
@@ -3202,14 +3212,14 @@ static int op_cnz(void)			/* CNZ nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_STACK;
 #endif
@@ -3241,14 +3251,14 @@ static int op_cc(void)			/* CC nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_WO | CPU_MEMR;
 #endif
@@ -3280,8 +3290,8 @@ static int op_cnc(void)			/* CNC nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
@@ -3292,8 +3302,8 @@ static int op_cnc(void)			/* CNC nn */
 #ifdef FRONTPANEL
 		fp_sampleLightGroup(0, 0);
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 		PC = ram + i;
 		return(17);
 	} else {
@@ -3319,14 +3329,14 @@ static int op_cpe(void)			/* CPE nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_STACK;
 #endif
@@ -3358,14 +3368,14 @@ static int op_cpo(void)			/* CPO nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_STACK;
 #endif
@@ -3397,14 +3407,14 @@ static int op_cm(void)			/* CM nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_STACK;
 #endif
@@ -3436,14 +3446,14 @@ static int op_cp(void)			/* CP nn */
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram) >> 8;
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 		if (STACK <= ram)
 			STACK =	ram + 65536L;
 #endif
-		*--STACK = (PC - ram);
-		touched[STACK-ram] = 1;
+		--STACK;
+		memwrt(STACK - ram, (PC - ram));
 #ifdef BUS_8080
 		cpu_bus = CPU_STACK;
 #endif
@@ -3694,14 +3704,14 @@ static int op_rst0(void)		/* RST 0 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram;
 	return(11);
 }
@@ -3718,14 +3728,14 @@ static int op_rst1(void)		/* RST 1 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x08;
 	return(11);
 }
@@ -3742,14 +3752,14 @@ static int op_rst2(void)		/* RST 2 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x10;
 	return(11);
 }
@@ -3766,14 +3776,14 @@ static int op_rst3(void)		/* RST 3 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x18;
 	return(11);
 }
@@ -3790,14 +3800,14 @@ static int op_rst4(void)		/* RST 4 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x20;
 	return(11);
 }
@@ -3814,14 +3824,14 @@ static int op_rst5(void)		/* RST 5 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x28;
 	return(11);
 }
@@ -3838,14 +3848,14 @@ static int op_rst6(void)		/* RST 6 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x30;
 	return(11);
 }
@@ -3862,14 +3872,14 @@ static int op_rst7(void)		/* RST 7 */
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram) >> 8;
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram) >> 8);
 #ifdef WANT_SPC
 	if (STACK <= ram)
 		STACK =	ram + 65536L;
 #endif
-	*--STACK = (PC - ram);
-	touched[STACK-ram] = 1;
+	--STACK;
+	memwrt(STACK - ram, (PC - ram));
 	PC = ram + 0x38;
 	return(11);
 }
@@ -0,0 +1,597 @@
+/*
+ * Z80SIM  -  a	Z80-CPU	simulator
+ *
+ * Copyright (C) 1987-2014 by Udo Munk
+ *
+ * This module is an alternative to sim1a.c. Instead of a call
+ * through a function pointer per opcode it dispatches with a
+ * computed goto (GCC/clang labels as values) or, with other
+ * compilers or -DCORE_SWITCH, a plain switch. The registers are
+ * kept in locals for the duration of a call and written back
+ * before any I/O and on return, and the cycle count of every
+ * opcode comes from a table.
+ *
+ * Select it with "make CORE=goto". It copies the flag quirks of
+ * the op_* functions in sim1a.c. PC and every memory operand wrap
+ * at 64K as WORDs here, where sim1a.c relies on the mirrors of
+ * ram[] (see memory.c).
+ *
+ * Only the configuration in sim.h used by the VT100 simulator is
+ * supported: WANT_TIM, WANT_PCC and WANT_SPC on, FRONTPANEL and
+ * BUS_8080 off. WANT_INT and HISIZE are honoured.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include "sim.h"
+#include "simglb.h"
+#include "memory.h"
+#include "opcodes.h"
+
+#if !defined(WANT_TIM) || !defined(WANT_PCC) || !defined(WANT_SPC)
+#error "sim1b.c needs WANT_TIM, WANT_PCC and WANT_SPC"
+#endif
+#if defined(FRONTPANEL) || defined(BUS_8080) || defined(WANT_GUI)
+#error "sim1b.c does not support FRONTPANEL, BUS_8080 or WANT_GUI"
+#endif
+
+#if defined(__GNUC__) && !defined(CORE_SWITCH)
+#define COMPUTED_GOTO
+#endif
+
+/*
+ *	Predecoded ROM. The basic ROM cannot change once it is loaded
+ *	(memwrt() drops writes to it), so every address in it is decoded
+ *	once: handler, operand, length and cycles. The cache is rebuilt
+ *	whenever rom_gen says a new image was loaded. The last two bytes
+ *	are left to the plain path, so an operand never reaches into RAM.
+ */
+struct predecoded {
+#ifdef COMPUTED_GOTO
+	const void *handler;		/* label of the opcode */
+#else
+	BYTE	op;			/* the opcode */
+#endif
+	WORD	opnd;			/* operand bytes, low byte first */
+	BYTE	len;			/* length of the instruction */
+	BYTE	cycles;			/* T-states, not taken for Ccc/Rcc */
+};
+
+#define PREDECODE_TOP	(ROM_TOP - 2)
+
+static CPU_LOCAL struct predecoded rom_cache[PREDECODE_TOP];
+static CPU_LOCAL int rom_cache_gen = -1;
+
+/*
+ *	S, Z and P flags for every result, built from parity[].
+ */
+static CPU_LOCAL BYTE szp[256];
+
+#define HL		((WORD) (h << 8 | l))
+#define BC		((WORD) (b << 8 | c))
+#define DE		((WORD) (d << 8 | e))
+
+#define RD(adr)		ram[(WORD) (adr)]
+#define WR(adr, v)	memwrt((WORD) (adr), (v))
+#define PUSH8(v)	{ sp--; WR(sp, v); }
+#define POP8()		ram[sp++]
+#define PUSH16(v)	{ PUSH8((v) >> 8); PUSH8((v) & 0xff); }
+#define POP16(v)	{ v = ram[sp++]; v |= ram[sp++] << 8; }
+
+#define SZHP		(S_FLAG | Z_FLAG | H_FLAG | P_FLAG)
+#define SET_SZHP(r, hx)	f = (f & ~SZHP) | szp[r] | ((hx) & H_FLAG)
+#define FLAG_S		(f & S_FLAG)
+#define FLAG_Z		(f & Z_FLAG)
+#define FLAG_P		(f & P_FLAG)
+#define FLAG_C		(f & C_FLAG)
+#define SET_C(cy)	f = (f & ~C_FLAG) | (cy)
+
+/*
+ *	Bit 4 of a ^ v ^ result is the carry or borrow out of the low
+ *	nibble, which is what the H flag of sim1a.c works out for every
+ *	addition, subtraction, increment and decrement.
+ */
+#define ADD(v)	{ register int _v = (v), _r = a + _v; \
+		  SET_C(_r >> 8); SET_SZHP(_r & 0xff, a ^ _v ^ _r); a = _r; }
+#define ADC(v)	{ register int _v = (v), _r = a + _v + FLAG_C; \
+		  SET_C(_r >> 8); SET_SZHP(_r & 0xff, a ^ _v ^ _r); a = _r; }
+#define SUB(v)	{ register int _v = (v), _r = a - _v; \
+		  SET_C((_r >> 8) & 1); SET_SZHP(_r & 0xff, a ^ _v ^ _r); a = _r; }
+#define SBB(v)	{ register int _v = (v), _r = a - _v - FLAG_C; \
+		  SET_C((_r >> 8) & 1); SET_SZHP(_r & 0xff, a ^ _v ^ _r); a = _r; }
+#define CMP(v)	{ register int _v = (v), _r = a - _v; \
+		  SET_C((_r >> 8) & 1); SET_SZHP(_r & 0xff, a ^ _v ^ _r); }
+#define ANA(v)	{ register int _v = (v), _h = (a | _v) << 1; \
+		  a &= _v; SET_C(0); SET_SZHP(a, _h); }
+#define ANI(v)	{ a &= (v); SET_C(0); SET_SZHP(a, 0); }
+#define XRA(v)	{ a ^= (v); SET_C(0); SET_SZHP(a, 0); }
+#define ORA(v)	{ a |= (v); SET_C(0); SET_SZHP(a, 0); }
+#define INR(r)	{ register int _o = r; r = _o + 1; SET_SZHP(r, _o ^ 1 ^ r); }
+#define DCR(r)	{ register int _o = r; r = _o - 1; SET_SZHP(r, _o ^ 1 ^ r); }
+#define DAD(v)	{ register unsigned _r = HL + (v); \
+		  SET_C(_r >> 16); h = _r >> 8; l = _r; }
+#define DAA()	{ if ((a & 0x0f) > 9 || (f & H_FLAG)) { \
+			f = ((a & 0x0f) + 6 > 0x0f) ? (f | H_FLAG) : (f & ~H_FLAG); \
+			a += 6; \
+		  } \
+		  if ((a & 0xf0) > 0x90 || (f & C_FLAG)) { \
+			if ((a & 0xf0) + 0x60 > 0xf0) \
+				f |= C_FLAG; \
+			a += 0x60; \
+		  } \
+		  f = (f & ~(S_FLAG | Z_FLAG | P_FLAG)) | szp[a]; }
+
+/* copy the registers between the locals and the globals */
+#define SAVE_REGS()	{ A = a; B = b; C = c; D = d; E = e; H = h; L = l; F = f; \
+			  PC = ram + pc; STACK = ram + sp; t_ticks = ticks; }
+#define LOAD_REGS()	{ a = A; b = B; c = C; d = D; e = E; h = H; l = L; f = F; \
+			  pc = PC - ram; sp = STACK - ram; ticks = t_ticks; }
+
+#ifdef COMPUTED_GOTO
+#define OPCODE(n)	L##n:
+#define END_OP		goto done
+#else
+#define OPCODE(n)	case n:
+#define END_OP		break
+#endif
+
+/*
+ *	This function builds the 8080 central processing unit.
+ *	The opcode where PC points to is fetched from the memory
+ *	and PC incremented by one. The opcode selects the code
+ *	which emulates this 8080 opcode.
+ *
+ *	In CONTIN_RUN mode opcodes are executed until t_ticks
+ *	reaches t_limit, so the caller can hand out a budget of
+ *	cycles and service its devices once per slice. The run
+ *	also ends when PC gets to an address marked BRK_EXEC in
+ *	brk_map[].
+ */
+void cpu_8080(void)
+{
+#ifdef COMPUTED_GOTO
+	static const void *const optab[256] = {
+		&&L0x00, &&L0x01, &&L0x02, &&L0x03, &&L0x04, &&L0x05, &&L0x06, &&L0x07,
+		&&L0x08, &&L0x09, &&L0x0a, &&L0x0b, &&L0x0c, &&L0x0d, &&L0x0e, &&L0x0f,
+		&&L0x10, &&L0x11, &&L0x12, &&L0x13, &&L0x14, &&L0x15, &&L0x16, &&L0x17,
+		&&L0x18, &&L0x19, &&L0x1a, &&L0x1b, &&L0x1c, &&L0x1d, &&L0x1e, &&L0x1f,
+		&&L0x20, &&L0x21, &&L0x22, &&L0x23, &&L0x24, &&L0x25, &&L0x26, &&L0x27,
+		&&L0x28, &&L0x29, &&L0x2a, &&L0x2b, &&L0x2c, &&L0x2d, &&L0x2e, &&L0x2f,
+		&&L0x30, &&L0x31, &&L0x32, &&L0x33, &&L0x34, &&L0x35, &&L0x36, &&L0x37,
+		&&L0x38, &&L0x39, &&L0x3a, &&L0x3b, &&L0x3c, &&L0x3d, &&L0x3e, &&L0x3f,
+		&&L0x40, &&L0x41, &&L0x42, &&L0x43, &&L0x44, &&L0x45, &&L0x46, &&L0x47,
+		&&L0x48, &&L0x49, &&L0x4a, &&L0x4b, &&L0x4c, &&L0x4d, &&L0x4e, &&L0x4f,
+		&&L0x50, &&L0x51, &&L0x52, &&L0x53, &&L0x54, &&L0x55, &&L0x56, &&L0x57,
+		&&L0x58, &&L0x59, &&L0x5a, &&L0x5b, &&L0x5c, &&L0x5d, &&L0x5e, &&L0x5f,
+		&&L0x60, &&L0x61, &&L0x62, &&L0x63, &&L0x64, &&L0x65, &&L0x66, &&L0x67,
+		&&L0x68, &&L0x69, &&L0x6a, &&L0x6b, &&L0x6c, &&L0x6d, &&L0x6e, &&L0x6f,
+		&&L0x70, &&L0x71, &&L0x72, &&L0x73, &&L0x74, &&L0x75, &&L0x76, &&L0x77,
+		&&L0x78, &&L0x79, &&L0x7a, &&L0x7b, &&L0x7c, &&L0x7d, &&L0x7e, &&L0x7f,
+		&&L0x80, &&L0x81, &&L0x82, &&L0x83, &&L0x84, &&L0x85, &&L0x86, &&L0x87,
+		&&L0x88, &&L0x89, &&L0x8a, &&L0x8b, &&L0x8c, &&L0x8d, &&L0x8e, &&L0x8f,
+		&&L0x90, &&L0x91, &&L0x92, &&L0x93, &&L0x94, &&L0x95, &&L0x96, &&L0x97,
+		&&L0x98, &&L0x99, &&L0x9a, &&L0x9b, &&L0x9c, &&L0x9d, &&L0x9e, &&L0x9f,
+		&&L0xa0, &&L0xa1, &&L0xa2, &&L0xa3, &&L0xa4, &&L0xa5, &&L0xa6, &&L0xa7,
+		&&L0xa8, &&L0xa9, &&L0xaa, &&L0xab, &&L0xac, &&L0xad, &&L0xae, &&L0xaf,
+		&&L0xb0, &&L0xb1, &&L0xb2, &&L0xb3, &&L0xb4, &&L0xb5, &&L0xb6, &&L0xb7,
+		&&L0xb8, &&L0xb9, &&L0xba, &&L0xbb, &&L0xbc, &&L0xbd, &&L0xbe, &&L0xbf,
+		&&L0xc0, &&L0xc1, &&L0xc2, &&L0xc3, &&L0xc4, &&L0xc5, &&L0xc6, &&L0xc7,
+		&&L0xc8, &&L0xc9, &&L0xca, &&L0xcb, &&L0xcc, &&L0xcd, &&L0xce, &&L0xcf,
+		&&L0xd0, &&L0xd1, &&L0xd2, &&L0xd3, &&L0xd4, &&L0xd5, &&L0xd6, &&L0xd7,
+		&&L0xd8, &&L0xd9, &&L0xda, &&L0xdb, &&L0xdc, &&L0xdd, &&L0xde, &&L0xdf,
+		&&L0xe0, &&L0xe1, &&L0xe2, &&L0xe3, &&L0xe4, &&L0xe5, &&L0xe6, &&L0xe7,
+		&&L0xe8, &&L0xe9, &&L0xea, &&L0xeb, &&L0xec, &&L0xed, &&L0xee, &&L0xef,
+		&&L0xf0, &&L0xf1, &&L0xf2, &&L0xf3, &&L0xf4, &&L0xf5, &&L0xf6, &&L0xf7,
+		&&L0xf8, &&L0xf9, &&L0xfa, &&L0xfb, &&L0xfc, &&L0xfd, &&L0xfe, &&L0xff
+	};
+#endif
+	register BYTE a, b, c, d, e, h, l;
+	register int f;
+	register WORD pc, sp;
+	register int states;
+	register BYTE op;
+	register WORD opnd;
+	unsigned long long ticks;
+	int t = 0;
+	struct timespec timer;
+	int i;
+
+	if (!szp[0])
+		for (i = 0; i < 256; i++) {
+			szp[i] = (i & S_FLAG) | (i ? 0 : Z_FLAG) |
+				 (parity[i] ? 0 : P_FLAG);
+		}
+
+	if (rom_cache_gen != rom_gen) {
+		for (i = 0; i < PREDECODE_TOP; i++) {
+			op = ram[i];
+#ifdef COMPUTED_GOTO
+			rom_cache[i].handler = optab[op];
+#else
+			rom_cache[i].op = op;
+#endif
+			rom_cache[i].opnd = ram[i + 1] | ram[i + 2] << 8;
+			rom_cache[i].len = oplen[op];
+			rom_cache[i].cycles = cycles[op];
+		}
+		rom_cache_gen = rom_gen;
+	}
+
+	LOAD_REGS();
+
+	do {
+
+#ifdef HISIZE		/* write history, if switched on */
+		if (his != NULL) {
+			struct history *hp = &his[h_next++ & h_mask];
+
+			hp->h_adr = pc;
+			hp->h_af = (a << 8) + (f & 0xff);
+			hp->h_bc = (b << 8) + c;
+			hp->h_de = (d << 8) + e;
+			hp->h_hl = (h << 8) + l;
+			hp->h_sp = sp;
+		}
+#endif
+
+		/* check for start address of runtime measurement */
+		if (ram + pc == t_start && !t_flag) {
+			t_flag = 1;	/* switch measurement on */
+			t_states = 0L;	/* initialise counted T-states */
+		}
+
+#ifdef WANT_INT		/* CPU interrupt handling */
+		if (int_int) {
+			if (IFF != 3)
+				goto leave;
+			if (int_protection) { /* protect first instr */
+				int_protection = 0; /* after EI */
+				goto leave;
+			}
+			IFF = 0;
+			if (cpu_halt) {	/* return behind the HLT */
+				cpu_halt = 0;
+				pc++;
+			}
+			PUSH16(pc);
+			if ((int_data & 0xc7) == 0xc7)	/* RST n */
+				pc = int_data & 0x38;
+			else
+				pc = 0;
+			int_int = 0;
+		}
+leave:
+#endif
+
+		if (pc < PREDECODE_TOP) {	/* ROM, already decoded */
+			register const struct predecoded *p = &rom_cache[pc];
+			opnd = p->opnd;
+			pc += p->len;
+			states = p->cycles;
+#ifdef COMPUTED_GOTO
+			goto *p->handler;
+#else
+			op = p->op;
+#endif
+		} else {
+			op = RD(pc);
+			opnd = RD(pc + 1) | RD(pc + 2) << 8;
+			pc += oplen[op];
+			states = cycles[op];
+#ifdef COMPUTED_GOTO
+			goto *optab[op];
+#endif
+		}
+#ifndef COMPUTED_GOTO
+		switch (op) {
+#endif
+
+	OPCODE(0x00)	/* NOP       */ END_OP;
+	OPCODE(0x01)	/* LXI B,nn  */ c = opnd; b = opnd >> 8; END_OP;
+	OPCODE(0x02)	/* STAX B    */ WR(BC, a); END_OP;
+	OPCODE(0x03)	/* INX B     */ if (++c == 0) b++; END_OP;
+	OPCODE(0x04)	/* INR B     */ INR(b); END_OP;
+	OPCODE(0x05)	/* DCR B     */ DCR(b); END_OP;
+	OPCODE(0x06)	/* MVI B,n   */ b = (BYTE) opnd; END_OP;
+	OPCODE(0x07)	/* RLC       */ f = (f & ~C_FLAG) | (a >> 7); a = a << 1 | a >> 7; END_OP;
+	OPCODE(0x09)	/* DAD B     */ DAD(b << 8 | c); END_OP;
+	OPCODE(0x0a)	/* LDAX B    */ a = RD(BC); END_OP;
+	OPCODE(0x0b)	/* DCX B     */ if (c-- == 0) b--; END_OP;
+	OPCODE(0x0c)	/* INR C     */ INR(c); END_OP;
+	OPCODE(0x0d)	/* DCR C     */ DCR(c); END_OP;
+	OPCODE(0x0e)	/* MVI C,n   */ c = (BYTE) opnd; END_OP;
+	OPCODE(0x0f)	/* RRC       */ f = (f & ~C_FLAG) | (a & 1); a = a >> 1 | a << 7; END_OP;
+	OPCODE(0x11)	/* LXI D,nn  */ e = opnd; d = opnd >> 8; END_OP;
+	OPCODE(0x12)	/* STAX D    */ WR(DE, a); END_OP;
+	OPCODE(0x13)	/* INX D     */ if (++e == 0) d++; END_OP;
+	OPCODE(0x14)	/* INR D     */ INR(d); END_OP;
+	OPCODE(0x15)	/* DCR D     */ DCR(d); END_OP;
+	OPCODE(0x16)	/* MVI D,n   */ d = (BYTE) opnd; END_OP;
+	OPCODE(0x17)	/* RAL       */ { int cy = f & C_FLAG; f = (f & ~C_FLAG) | (a >> 7); a = a << 1 | cy; } END_OP;
+	OPCODE(0x19)	/* DAD D     */ DAD(d << 8 | e); END_OP;
+	OPCODE(0x1a)	/* LDAX D    */ a = RD(DE); END_OP;
+	OPCODE(0x1b)	/* DCX D     */ if (e-- == 0) d--; END_OP;
+	OPCODE(0x1c)	/* INR E     */ INR(e); END_OP;
+	OPCODE(0x1d)	/* DCR E     */ DCR(e); END_OP;
+	OPCODE(0x1e)	/* MVI E,n   */ e = (BYTE) opnd; END_OP;
+	OPCODE(0x1f)	/* RAR       */ { int cy = f & C_FLAG; f = (f & ~C_FLAG) | (a & 1); a = a >> 1 | cy << 7; } END_OP;
+	OPCODE(0x21)	/* LXI H,nn  */ l = opnd; h = opnd >> 8; END_OP;
+	OPCODE(0x22)	/* SHLD nn   */ { WR(opnd, l); WR(opnd + 1, h); } END_OP;
+	OPCODE(0x23)	/* INX H     */ if (++l == 0) h++; END_OP;
+	OPCODE(0x24)	/* INR H     */ INR(h); END_OP;
+	OPCODE(0x25)	/* DCR H     */ DCR(h); END_OP;
+	OPCODE(0x26)	/* MVI H,n   */ h = (BYTE) opnd; END_OP;
+	OPCODE(0x27)	/* DAA       */ DAA(); END_OP;
+	OPCODE(0x29)	/* DAD H     */ DAD(h << 8 | l); END_OP;
+	OPCODE(0x2a)	/* LHLD nn   */ { l = RD(opnd); h = RD(opnd + 1); } END_OP;
+	OPCODE(0x2b)	/* DCX H     */ if (l-- == 0) h--; END_OP;
+	OPCODE(0x2c)	/* INR L     */ INR(l); END_OP;
+	OPCODE(0x2d)	/* DCR L     */ DCR(l); END_OP;
+	OPCODE(0x2e)	/* MVI L,n   */ l = (BYTE) opnd; END_OP;
+	OPCODE(0x2f)	/* CMA       */ a = ~a; END_OP;
+	OPCODE(0x31)	/* LXI SP,nn */ sp = opnd; END_OP;
+	OPCODE(0x32)	/* STA nn    */ WR(opnd, a); END_OP;
+	OPCODE(0x33)	/* INX SP    */ sp++; END_OP;
+	OPCODE(0x34)	/* INR M     */ { BYTE v = RD(HL); INR(v); WR(HL, v); } END_OP;
+	OPCODE(0x35)	/* DCR M     */ { BYTE v = RD(HL); DCR(v); WR(HL, v); } END_OP;
+	OPCODE(0x36)	/* MVI M,n   */ WR(HL, (BYTE) opnd); END_OP;
+	OPCODE(0x37)	/* STC       */ f |= C_FLAG; END_OP;
+	OPCODE(0x39)	/* DAD SP    */ DAD(sp); END_OP;
+	OPCODE(0x3a)	/* LDA nn    */ a = RD(opnd); END_OP;
+	OPCODE(0x3b)	/* DCX SP    */ sp--; END_OP;
+	OPCODE(0x3c)	/* INR A     */ INR(a); END_OP;
+	OPCODE(0x3d)	/* DCR A     */ DCR(a); END_OP;
+	OPCODE(0x3e)	/* MVI A,n   */ a = (BYTE) opnd; END_OP;
+	OPCODE(0x3f)	/* CMC       */ f ^= C_FLAG; END_OP;
+	OPCODE(0x40)	/* MOV B,B   */ b = b; END_OP;
+	OPCODE(0x41)	/* MOV B,C   */ b = c; END_OP;
+	OPCODE(0x42)	/* MOV B,D   */ b = d; END_OP;
+	OPCODE(0x43)	/* MOV B,E   */ b = e; END_OP;
+	OPCODE(0x44)	/* MOV B,H   */ b = h; END_OP;
+	OPCODE(0x45)	/* MOV B,L   */ b = l; END_OP;
+	OPCODE(0x46)	/* MOV B,M   */ b = RD(HL); END_OP;
+	OPCODE(0x47)	/* MOV B,A   */ b = a; END_OP;
+	OPCODE(0x48)	/* MOV C,B   */ c = b; END_OP;
+	OPCODE(0x49)	/* MOV C,C   */ c = c; END_OP;
+	OPCODE(0x4a)	/* MOV C,D   */ c = d; END_OP;
+	OPCODE(0x4b)	/* MOV C,E   */ c = e; END_OP;
+	OPCODE(0x4c)	/* MOV C,H   */ c = h; END_OP;
+	OPCODE(0x4d)	/* MOV C,L   */ c = l; END_OP;
+	OPCODE(0x4e)	/* MOV C,M   */ c = RD(HL); END_OP;
+	OPCODE(0x4f)	/* MOV C,A   */ c = a; END_OP;
+	OPCODE(0x50)	/* MOV D,B   */ d = b; END_OP;
+	OPCODE(0x51)	/* MOV D,C   */ d = c; END_OP;
+	OPCODE(0x52)	/* MOV D,D   */ d = d; END_OP;
+	OPCODE(0x53)	/* MOV D,E   */ d = e; END_OP;
+	OPCODE(0x54)	/* MOV D,H   */ d = h; END_OP;
+	OPCODE(0x55)	/* MOV D,L   */ d = l; END_OP;
+	OPCODE(0x56)	/* MOV D,M   */ d = RD(HL); END_OP;
+	OPCODE(0x57)	/* MOV D,A   */ d = a; END_OP;
+	OPCODE(0x58)	/* MOV E,B   */ e = b; END_OP;
+	OPCODE(0x59)	/* MOV E,C   */ e = c; END_OP;
+	OPCODE(0x5a)	/* MOV E,D   */ e = d; END_OP;
+	OPCODE(0x5b)	/* MOV E,E   */ e = e; END_OP;
+	OPCODE(0x5c)	/* MOV E,H   */ e = h; END_OP;
+	OPCODE(0x5d)	/* MOV E,L   */ e = l; END_OP;
+	OPCODE(0x5e)	/* MOV E,M   */ e = RD(HL); END_OP;
+	OPCODE(0x5f)	/* MOV E,A   */ e = a; END_OP;
+	OPCODE(0x60)	/* MOV H,B   */ h = b; END_OP;
+	OPCODE(0x61)	/* MOV H,C   */ h = c; END_OP;
+	OPCODE(0x62)	/* MOV H,D   */ h = d; END_OP;
+	OPCODE(0x63)	/* MOV H,E   */ h = e; END_OP;
+	OPCODE(0x64)	/* MOV H,H   */ h = h; END_OP;
+	OPCODE(0x65)	/* MOV H,L   */ h = l; END_OP;
+	OPCODE(0x66)	/* MOV H,M   */ h = RD(HL); END_OP;
+	OPCODE(0x67)	/* MOV H,A   */ h = a; END_OP;
+	OPCODE(0x68)	/* MOV L,B   */ l = b; END_OP;
+	OPCODE(0x69)	/* MOV L,C   */ l = c; END_OP;
+	OPCODE(0x6a)	/* MOV L,D   */ l = d; END_OP;
+	OPCODE(0x6b)	/* MOV L,E   */ l = e; END_OP;
+	OPCODE(0x6c)	/* MOV L,H   */ l = h; END_OP;
+	OPCODE(0x6d)	/* MOV L,L   */ l = l; END_OP;
+	OPCODE(0x6e)	/* MOV L,M   */ l = RD(HL); END_OP;
+	OPCODE(0x6f)	/* MOV L,A   */ l = a; END_OP;
+	OPCODE(0x70)	/* MOV M,B   */ WR(HL, b); END_OP;
+	OPCODE(0x71)	/* MOV M,C   */ WR(HL, c); END_OP;
+	OPCODE(0x72)	/* MOV M,D   */ WR(HL, d); END_OP;
+	OPCODE(0x73)	/* MOV M,E   */ WR(HL, e); END_OP;
+	OPCODE(0x74)	/* MOV M,H   */ WR(HL, h); END_OP;
+	OPCODE(0x75)	/* MOV M,L   */ WR(HL, l); END_OP;
+	OPCODE(0x77)	/* MOV M,A   */ WR(HL, a); END_OP;
+	OPCODE(0x78)	/* MOV A,B   */ a = b; END_OP;
+	OPCODE(0x79)	/* MOV A,C   */ a = c; END_OP;
+	OPCODE(0x7a)	/* MOV A,D   */ a = d; END_OP;
+	OPCODE(0x7b)	/* MOV A,E   */ a = e; END_OP;
+	OPCODE(0x7c)	/* MOV A,H   */ a = h; END_OP;
+	OPCODE(0x7d)	/* MOV A,L   */ a = l; END_OP;
+	OPCODE(0x7e)	/* MOV A,M   */ a = RD(HL); END_OP;
+	OPCODE(0x7f)	/* MOV A,A   */ a = a; END_OP;
+	OPCODE(0x80)	/* ADD B     */ ADD(b); END_OP;
+	OPCODE(0x81)	/* ADD C     */ ADD(c); END_OP;
+	OPCODE(0x82)	/* ADD D     */ ADD(d); END_OP;
+	OPCODE(0x83)	/* ADD E     */ ADD(e); END_OP;
+	OPCODE(0x84)	/* ADD H     */ ADD(h); END_OP;
+	OPCODE(0x85)	/* ADD L     */ ADD(l); END_OP;
+	OPCODE(0x86)	/* ADD M     */ ADD(RD(HL)); END_OP;
+	OPCODE(0x87)	/* ADD A     */ ADD(a); END_OP;
+	OPCODE(0x88)	/* ADC B     */ ADC(b); END_OP;
+	OPCODE(0x89)	/* ADC C     */ ADC(c); END_OP;
+	OPCODE(0x8a)	/* ADC D     */ ADC(d); END_OP;
+	OPCODE(0x8b)	/* ADC E     */ ADC(e); END_OP;
+	OPCODE(0x8c)	/* ADC H     */ ADC(h); END_OP;
+	OPCODE(0x8d)	/* ADC L     */ ADC(l); END_OP;
+	OPCODE(0x8e)	/* ADC M     */ ADC(RD(HL)); END_OP;
+	OPCODE(0x8f)	/* ADC A     */ ADC(a); END_OP;
+	OPCODE(0x90)	/* SUB B     */ SUB(b); END_OP;
+	OPCODE(0x91)	/* SUB C     */ SUB(c); END_OP;
+	OPCODE(0x92)	/* SUB D     */ SUB(d); END_OP;
+	OPCODE(0x93)	/* SUB E     */ SUB(e); END_OP;
+	OPCODE(0x94)	/* SUB H     */ SUB(h); END_OP;
+	OPCODE(0x95)	/* SUB L     */ SUB(l); END_OP;
+	OPCODE(0x96)	/* SUB M     */ SUB(RD(HL)); END_OP;
+	OPCODE(0x97)	/* SUB A     */ SUB(a); END_OP;
+	OPCODE(0x98)	/* SBB B     */ SBB(b); END_OP;
+	OPCODE(0x99)	/* SBB C     */ SBB(c); END_OP;
+	OPCODE(0x9a)	/* SBB D     */ SBB(d); END_OP;
+	OPCODE(0x9b)	/* SBB E     */ SBB(e); END_OP;
+	OPCODE(0x9c)	/* SBB H     */ SBB(h); END_OP;
+	OPCODE(0x9d)	/* SBB L     */ SBB(l); END_OP;
+	OPCODE(0x9e)	/* SBB M     */ SBB(RD(HL)); END_OP;
+	OPCODE(0x9f)	/* SBB A     */ SBB(a); END_OP;
+	OPCODE(0xa0)	/* ANA B     */ ANA(b); END_OP;
+	OPCODE(0xa1)	/* ANA C     */ ANA(c); END_OP;
+	OPCODE(0xa2)	/* ANA D     */ ANA(d); END_OP;
+	OPCODE(0xa3)	/* ANA E     */ ANA(e); END_OP;
+	OPCODE(0xa4)	/* ANA H     */ ANA(h); END_OP;
+	OPCODE(0xa5)	/* ANA L     */ ANA(l); END_OP;
+	OPCODE(0xa6)	/* ANA M     */ ANA(RD(HL)); END_OP;
+	OPCODE(0xa7)	/* ANA A     */ ANA(a); END_OP;
+	OPCODE(0xa8)	/* XRA B     */ XRA(b); END_OP;
+	OPCODE(0xa9)	/* XRA C     */ XRA(c); END_OP;
+	OPCODE(0xaa)	/* XRA D     */ XRA(d); END_OP;
+	OPCODE(0xab)	/* XRA E     */ XRA(e); END_OP;
+	OPCODE(0xac)	/* XRA H     */ XRA(h); END_OP;
+	OPCODE(0xad)	/* XRA L     */ XRA(l); END_OP;
+	OPCODE(0xae)	/* XRA M     */ XRA(RD(HL)); END_OP;
+	OPCODE(0xaf)	/* XRA A     */ XRA(a); END_OP;
+	OPCODE(0xb0)	/* ORA B     */ ORA(b); END_OP;
+	OPCODE(0xb1)	/* ORA C     */ ORA(c); END_OP;
+	OPCODE(0xb2)	/* ORA D     */ ORA(d); END_OP;
+	OPCODE(0xb3)	/* ORA E     */ ORA(e); END_OP;
+	OPCODE(0xb4)	/* ORA H     */ ORA(h); END_OP;
+	OPCODE(0xb5)	/* ORA L     */ ORA(l); END_OP;
+	OPCODE(0xb6)	/* ORA M     */ ORA(RD(HL)); END_OP;
+	OPCODE(0xb7)	/* ORA A     */ ORA(a); END_OP;
+	OPCODE(0xb8)	/* CMP B     */ CMP(b); END_OP;
+	OPCODE(0xb9)	/* CMP C     */ CMP(c); END_OP;
+	OPCODE(0xba)	/* CMP D     */ CMP(d); END_OP;
+	OPCODE(0xbb)	/* CMP E     */ CMP(e); END_OP;
+	OPCODE(0xbc)	/* CMP H     */ CMP(h); END_OP;
+	OPCODE(0xbd)	/* CMP L     */ CMP(l); END_OP;
+	OPCODE(0xbe)	/* CMP M     */ CMP(RD(HL)); END_OP;
+	OPCODE(0xbf)	/* CMP A     */ f = (f & ~(S_FLAG | H_FLAG | P_FLAG | C_FLAG)) | Z_FLAG; END_OP;
+	OPCODE(0xc0)	/* RNZ       */ if (!FLAG_Z) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xc1)	/* POP B     */ c = POP8(); b = POP8(); END_OP;
+	OPCODE(0xc2)	/* JNZ nn    */ if (!FLAG_Z) pc = opnd; END_OP;
+	OPCODE(0xc3)	/* JMP nn    */ pc = opnd; END_OP;
+	OPCODE(0xc4)	/* CNZ nn    */ if (!FLAG_Z) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xc5)	/* PUSH B    */ PUSH8(b); PUSH8(c); END_OP;
+	OPCODE(0xc6)	/* ADI n     */ ADD((BYTE) opnd); END_OP;
+	OPCODE(0xc7)	/* RST 0     */ PUSH16(pc); pc = 0x00; END_OP;
+	OPCODE(0xc8)	/* RZ        */ if (FLAG_Z) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xc9)	/* RET       */ POP16(pc); END_OP;
+	OPCODE(0xca)	/* JZ nn     */ if (FLAG_Z) pc = opnd; END_OP;
+	OPCODE(0xcc)	/* CZ nn     */ if (FLAG_Z) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xcd)	/* CALL nn   */ { PUSH16(pc); pc = opnd; } END_OP;
+	OPCODE(0xce)	/* ACI n     */ ADC((BYTE) opnd); END_OP;
+	OPCODE(0xcf)	/* RST 1     */ PUSH16(pc); pc = 0x08; END_OP;
+	OPCODE(0xd0)	/* RNC       */ if (!FLAG_C) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xd1)	/* POP D     */ e = POP8(); d = POP8(); END_OP;
+	OPCODE(0xd2)	/* JNC nn    */ if (!FLAG_C) pc = opnd; END_OP;
+	OPCODE(0xd4)	/* CNC nn    */ if (!FLAG_C) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xd5)	/* PUSH D    */ PUSH8(d); PUSH8(e); END_OP;
+	OPCODE(0xd6)	/* SUI n     */ SUB((BYTE) opnd); END_OP;
+	OPCODE(0xd7)	/* RST 2     */ PUSH16(pc); pc = 0x10; END_OP;
+	OPCODE(0xd8)	/* RC        */ if (FLAG_C) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xda)	/* JC nn     */ if (FLAG_C) pc = opnd; END_OP;
+	OPCODE(0xdc)	/* CC nn     */ if (FLAG_C) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xde)	/* SBI n     */ SBB((BYTE) opnd); END_OP;
+	OPCODE(0xdf)	/* RST 3     */ PUSH16(pc); pc = 0x18; END_OP;
+	OPCODE(0xe0)	/* RPO       */ if (!FLAG_P) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xe1)	/* POP H     */ l = POP8(); h = POP8(); END_OP;
+	OPCODE(0xe2)	/* JPO nn    */ if (!FLAG_P) pc = opnd; END_OP;
+	OPCODE(0xe3)	/* XTHL      */ { BYTE i = RD(sp); WR(sp, l); l = i; i = RD(sp + 1); WR(sp + 1, h); h = i; } END_OP;
+	OPCODE(0xe4)	/* CPO nn    */ if (!FLAG_P) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xe5)	/* PUSH H    */ PUSH8(h); PUSH8(l); END_OP;
+	OPCODE(0xe6)	/* ANI n     */ ANI((BYTE) opnd); END_OP;
+	OPCODE(0xe7)	/* RST 4     */ PUSH16(pc); pc = 0x20; END_OP;
+	OPCODE(0xe8)	/* RPE       */ if (FLAG_P) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xe9)	/* PCHL      */ pc = HL; END_OP;
+	OPCODE(0xea)	/* JPE nn    */ if (FLAG_P) pc = opnd; END_OP;
+	OPCODE(0xeb)	/* XCHG      */ { BYTE i = d; d = h; h = i; i = e; e = l; l = i; } END_OP;
+	OPCODE(0xec)	/* CPE nn    */ if (FLAG_P) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xee)	/* XRI n     */ XRA((BYTE) opnd); END_OP;
+	OPCODE(0xef)	/* RST 5     */ PUSH16(pc); pc = 0x28; END_OP;
+	OPCODE(0xf0)	/* RP        */ if (!FLAG_S) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xf1)	/* POP PSW   */ f = POP8(); a = POP8(); END_OP;
+	OPCODE(0xf2)	/* JP nn     */ if (!FLAG_S) pc = opnd; END_OP;
+	OPCODE(0xf3)	/* DI        */ IFF = 0; END_OP;
+	OPCODE(0xf4)	/* CP nn     */ if (!FLAG_S) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xf5)	/* PUSH PSW  */ PUSH8(a); PUSH8(f); END_OP;
+	OPCODE(0xf6)	/* ORI n     */ ORA((BYTE) opnd); END_OP;
+	OPCODE(0xf7)	/* RST 6     */ PUSH16(pc); pc = 0x30; END_OP;
+	OPCODE(0xf8)	/* RM        */ if (FLAG_S) { POP16(pc); states += 6; } END_OP;
+	OPCODE(0xf9)	/* SPHL      */ sp = HL; END_OP;
+	OPCODE(0xfa)	/* JM nn     */ if (FLAG_S) pc = opnd; END_OP;
+	OPCODE(0xfb)	/* EI        */ IFF = 3; int_protection = 1; END_OP;
+	OPCODE(0xfc)	/* CM nn     */ if (FLAG_S) { PUSH16(pc); pc = opnd; states += 6; } END_OP;
+	OPCODE(0xfe)	/* CPI n     */ CMP((BYTE) opnd); END_OP;
+	OPCODE(0xff)	/* RST 7     */ PUSH16(pc); pc = 0x38; END_OP;
+
+	OPCODE(0x08) OPCODE(0x10) OPCODE(0x18) OPCODE(0x20)
+	OPCODE(0x28) OPCODE(0x30) OPCODE(0x38) OPCODE(0xcb)
+	OPCODE(0xd9) OPCODE(0xdd) OPCODE(0xed) OPCODE(0xfd)
+		/* illegal opcode */
+		cpu_error = OPTRAP1;
+		cpu_state = STOPPED;
+		END_OP;
+
+	OPCODE(0x76)	/* HLT */
+		if (IFF == 0) {
+			cpu_error = OPHALT;
+			cpu_state = STOPPED;
+		} else {
+			/* stay on the HLT until the caller raises an
+			   interrupt, see op_hlt() in sim1a.c */
+			pc--;
+			cpu_halt = 1;
+			if (cpu_state == CONTIN_RUN && !int_int &&
+			    t_limit != ~0ULL && t_limit > ticks + 7)
+				states = t_limit - ticks;
+		}
+		busy_loop_cnt[0] = 0;
+		END_OP;
+
+	OPCODE(0xd3)	/* OUT n */
+		SAVE_REGS();
+		cpu_io.out(cpu_io.ctx, opnd, a);
+		END_OP;
+
+	OPCODE(0xdb)	/* IN n */
+		SAVE_REGS();
+		a = cpu_io.in(cpu_io.ctx, opnd);
+		ticks = t_ticks;	/* idle loops are fast-forwarded */
+		END_OP;
+
+#ifndef COMPUTED_GOTO
+		}
+#else
+done:
+#endif
+		t += states;
+		if (f_flag) {		/* adjust CPU speed */
+			if (t > tmax) {
+				timer.tv_sec = 0;
+				timer.tv_nsec = 10000000;
+				nanosleep(&timer, NULL);
+				t = 0;
+			}
+		}
+
+		R++;			/* increment refresh register */
+
+		if (t_flag) {		/* do runtime measurement */
+			t_states += states; /* add T-states for this opcode */
+			if (ram + pc == t_end) /* check for end address */
+				t_flag = 0; /* if reached, switch off */
+		}
+		ticks += states;
+
+		if (brk_map[pc] & BRK_EXEC)	/* breakpoint ahead */
+			cpu_state = SINGLE_STEP;
+
+	} while	(cpu_state == CONTIN_RUN && ticks < t_limit);
+
+	SAVE_REGS();
+}
@@ -32,7 +32,9 @@
  */
 
 /*
- *	This module contains all the global variables
+ *	This module contains all the global variables. The state of
+ *	the CPU is CPU_LOCAL: each thread runs one machine at a time,
+ *	and machine.c moves a machine in and out of these.
  */
 
 #include "sim.h"
@@ -42,65 +44,77 @@
 /*
  *	Type of CPU, either Z80 or 8080
  */
-int cpu = DEFAULT_CPU;
+CPU_LOCAL int cpu = DEFAULT_CPU;
 
 /*
  *	CPU Registers
  */
-BYTE A,B,C,D,E,H,L;		/* Z80 primary registers */
-int  F;				/* normally 8-Bit, but int is faster */
-WORD IX, IY;
-BYTE A_,B_,C_,D_,E_,H_,L_;	/* Z80 alternate registers */
-int  F_;
-BYTE *PC;			/* Z80 programm counter */
-BYTE *STACK;			/* Z80 stackpointer */
-BYTE I;				/* Z80 interrupt register */
-BYTE IFF;			/* Z80 interrupt flags */
-long R;				/* Z80 refresh register */
+CPU_LOCAL BYTE A,B,C,D,E,H,L;	/* Z80 primary registers */
+CPU_LOCAL int  F;		/* normally 8-Bit, but int is faster */
+CPU_LOCAL WORD IX, IY;
+CPU_LOCAL BYTE A_,B_,C_,D_,E_,H_,L_;	/* Z80 alternate registers */
+CPU_LOCAL int  F_;
+CPU_LOCAL BYTE *PC;		/* Z80 programm counter */
+CPU_LOCAL BYTE *STACK;		/* Z80 stackpointer */
+CPU_LOCAL BYTE I;		/* Z80 interrupt register */
+CPU_LOCAL BYTE IFF;		/* Z80 interrupt flags */
+CPU_LOCAL long R;		/* Z80 refresh register */
 				/* is normally a 8 bit register	*/
 				/* the 32 bits are used to measure the */
 				/* clock frequency */
 
 #ifdef BUS_8080			/* CPU bus status, for frontpanels */
-BYTE cpu_bus;
+CPU_LOCAL BYTE cpu_bus;
 #endif
 
-BYTE io_port;			/* I/O port used */
-BYTE mem_wp;			/* memory write-protect flag */
+CPU_LOCAL struct cpu_io cpu_io;	/* where IN, OUT and hooked stores go */
+CPU_LOCAL BYTE io_port;		/* I/O port used */
+CPU_LOCAL BYTE mem_wp;		/* memory write-protect flag */
 
 /*
  *	Variables for memory of the emulated CPU
  */
-BYTE ram[65536];		/* 64KB RAM */
-BYTE touched[65536];		/* 64KB RAM */
-BYTE *wrk_ram;			/* workpointer into memory for dump etc. */
+CPU_LOCAL BYTE *ram;		/* 64KB RAM, mirrored; see memory.c */
+#ifdef WANT_DIRTY
+CPU_LOCAL BYTE *dirty;		/* a bit per byte written, see memory.h */
+#endif
+CPU_LOCAL BYTE *brk_map;	/* BRK_* flags of every address */
+CPU_LOCAL int brk_on;		/* number of breakpoints and watchpoints */
+CPU_LOCAL BYTE mem_page[256];	/* MEM_* kind of every 256 byte page */
+CPU_LOCAL int rom_gen;		/* number of the ROM image loaded, see */
+				/* mem_rom_loaded() */
+CPU_LOCAL WORD mem_log[MEMLOG];	/* addresses of the bytes changed, */
+CPU_LOCAL BYTE mem_log_old[MEMLOG];	/* their values before */
+CPU_LOCAL int mem_logged;	/* their number, MEMLOG + 1 if more */
+CPU_LOCAL BYTE *wrk_ram;	/* workpointer into memory for dump etc. */
 
 /*
  *	Variables for history memory
  */
 #ifdef HISIZE
-struct history his[HISIZE];	/* memory to hold trace informations */
-int h_next;			/* index into trace memory */
-int h_flag;			/* flag for trace memory overrun */
+CPU_LOCAL struct history *his;	/* ring of trace informations, NULL: off */
+CPU_LOCAL unsigned long h_mask;	/* its number of entries - 1, a power of 2 */
+CPU_LOCAL unsigned long h_next;	/* entries written, his[h_next & h_mask] next */
 #endif
 
 /*
  *	Variables for breakpoint memory
  */
 #ifdef SBSIZE
-struct softbreak soft[SBSIZE];	/* memory to hold breakpoint informations */
-int sb_next;			/* index into breakpoint memory */
+CPU_LOCAL struct softbreak soft[SBSIZE]; /* memory to hold breakpoint informations */
+CPU_LOCAL int sb_next;		/* index into breakpoint memory */
 #endif
 
 /*
  *	Variables for runtime measurement
  */
 #ifdef WANT_TIM
-long t_states;			/* number of counted T states */
-int t_flag;			/* flag, 1 = on, 0 = off */
-BYTE *t_start =	ram + 65535;	/* start address for measurement */
-BYTE *t_end = ram + 65535;	/* end address for measurement */
-unsigned long long t_ticks = 0;
+CPU_LOCAL long t_states;	/* number of counted T states */
+CPU_LOCAL int t_flag;		/* flag, 1 = on, 0 = off */
+CPU_LOCAL BYTE *t_start;	/* start address for measurement */
+CPU_LOCAL BYTE *t_end;		/* end address for measurement */
+CPU_LOCAL unsigned long long t_ticks = 0;
+CPU_LOCAL unsigned long long t_limit = ~0ULL;	/* CONTIN_RUN stops when t_ticks reaches this */
 #endif
 
 /*
@@ -117,31 +131,32 @@ BYTE fp_led_output;		/* IMSAI programmed output */
 /*
  *	Flags to control operation of simulation
  */
-int s_flag;			/* flag	for -s option */
-int l_flag;			/* flag	for -l option */
-int m_flag;			/* flag	for -m option */
-int x_flag;			/* flag	for -x option */
-int i_flag;			/* flag for -i option */
-int f_flag;			/* flag for -f option */
+CPU_LOCAL int s_flag;		/* flag	for -s option */
+CPU_LOCAL int l_flag;		/* flag	for -l option */
+CPU_LOCAL int m_flag;		/* flag	for -m option */
+CPU_LOCAL int x_flag;		/* flag	for -x option */
+CPU_LOCAL int i_flag;		/* flag for -i option */
+CPU_LOCAL int f_flag;		/* flag for -f option */
 #ifdef Z80_UNDOC
-int u_flag;			/* flag for -u option */
+CPU_LOCAL int u_flag;		/* flag for -u option */
 #endif
-char xfn[LENCMD];		/* buffer for filename (option -x) */
-BYTE cpu_state;			/* status of CPU emulation */
-int cpu_error;			/* error status of CPU emulation */
-int int_nmi;;			/* non maskable interrupt */
-int int_int;			/* interrupt */
-int tmax;			/* max t-stats to execute in 10ms */
-int int_mode;			/* CPU interrupt mode (IM 0, IM 1, IM 2) */
-BYTE int_data;			/* data from interrupting device on data bus */
-int int_protection = 0;		/* to delay interrupts after EI */
-int cntl_c;			/* flag	for cntl-c entered */
-int cntl_bs;			/* flag	for cntl-\ entered */
+CPU_LOCAL char xfn[LENCMD];	/* buffer for filename (option -x) */
+CPU_LOCAL BYTE cpu_state;	/* status of CPU emulation */
+CPU_LOCAL int cpu_error;	/* error status of CPU emulation */
+CPU_LOCAL int int_nmi;;		/* non maskable interrupt */
+CPU_LOCAL int int_int;		/* interrupt */
+CPU_LOCAL int tmax;		/* max t-stats to execute in 10ms */
+CPU_LOCAL int int_mode;		/* CPU interrupt mode (IM 0, IM 1, IM 2) */
+CPU_LOCAL BYTE int_data;	/* data from interrupting device on data bus */
+CPU_LOCAL int int_protection = 0;	/* to delay interrupts after EI */
+CPU_LOCAL int cpu_halt = 0;	/* HLT is waiting for an interrupt */
+CPU_LOCAL int cntl_c;		/* flag	for cntl-c entered */
+CPU_LOCAL int cntl_bs;		/* flag	for cntl-\ entered */
 
 /*
  *	Variables for I/O support
  */
-int busy_loop_cnt[MAXCHAN];	/* counters for I/O busy loop detection */
+CPU_LOCAL int busy_loop_cnt[MAXCHAN];	/* counters for I/O busy loop detection */
 
 /*
  *	Precompiled table to get parity as fast as possible
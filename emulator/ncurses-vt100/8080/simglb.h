@@ -35,49 +35,61 @@
  *	Declaration of variables in simglb.c
  */
 
-extern int	cpu;
+extern CPU_LOCAL int	cpu;
 
-extern BYTE	A, B, C, D, E, H, L, A_, B_, C_, D_, E_, H_, L_,
+extern CPU_LOCAL BYTE	A, B, C, D, E, H, L, A_, B_, C_, D_, E_, H_, L_,
 		*PC, *STACK, I, IFF;
-extern WORD	IX, IY;
-extern int	F, F_;
-extern long	R;
-extern BYTE	io_port;
-extern BYTE	mem_wp;
+extern CPU_LOCAL WORD	IX, IY;
+extern CPU_LOCAL int	F, F_;
+extern CPU_LOCAL long	R;
+extern CPU_LOCAL struct cpu_io cpu_io;
+extern CPU_LOCAL BYTE	io_port;
+extern CPU_LOCAL BYTE	mem_wp;
 
 #ifdef BUS_8080
-extern BYTE	cpu_bus;
+extern CPU_LOCAL BYTE	cpu_bus;
 #endif
 
-extern BYTE	ram[],touched[],*wrk_ram, cpu_state, int_data;
+extern CPU_LOCAL BYTE	*ram,*wrk_ram, cpu_state, int_data;
+#ifdef WANT_DIRTY
+extern CPU_LOCAL BYTE	*dirty;
+#endif
+extern CPU_LOCAL int	rom_gen;
+extern CPU_LOCAL BYTE	*brk_map, mem_page[];
+extern CPU_LOCAL int	brk_on;
+extern CPU_LOCAL WORD	mem_log[];
+extern CPU_LOCAL BYTE	mem_log_old[];
+extern CPU_LOCAL int	mem_logged;
 
-extern int	s_flag, l_flag, m_flag, x_flag, break_flag, i_flag, f_flag,
+extern CPU_LOCAL int s_flag, l_flag, m_flag, x_flag, break_flag, i_flag, f_flag,
 		cpu_error, int_nmi, int_int, int_mode, cntl_c, cntl_bs,
-		parity[], sb_next, int_protection;
+		sb_next, int_protection, cpu_halt;
+extern int	parity[];
 
 #ifdef Z80_UNDOC
-extern int	u_flag;
+extern CPU_LOCAL int	u_flag;
 #endif
 
-extern int	tmax;
-extern int	busy_loop_cnt[];
+extern CPU_LOCAL int	tmax;
+extern CPU_LOCAL int	busy_loop_cnt[];
 
-extern char	xfn[];
+extern CPU_LOCAL char	xfn[];
 
 #ifdef HISIZE
-extern struct	history	his[];
-extern int	h_next,	h_flag;
+extern CPU_LOCAL struct	history	*his;
+extern CPU_LOCAL unsigned long h_mask, h_next;
 #endif
 
 #ifdef SBSIZE
-extern struct	softbreak soft[];
+extern CPU_LOCAL struct	softbreak soft[];
 #endif
 
 #ifdef WANT_TIM
-extern long	t_states;
-extern int	t_flag;
-extern BYTE	*t_start, *t_end;
-extern unsigned long long t_ticks;
+extern CPU_LOCAL long	t_states;
+extern CPU_LOCAL int	t_flag;
+extern CPU_LOCAL BYTE	*t_start, *t_end;
+extern CPU_LOCAL unsigned long long t_ticks;
+extern CPU_LOCAL unsigned long long t_limit;
 #endif
 
 #ifdef FRONTPANEL
@@ -0,0 +1,324 @@
+// vt100headless: run a VT100 without a terminal, for tests and batch
+// jobs. The machine is the one of vt100sim, with $SHELL (or the --exec
+// program) on its PTY, or the --line host, but curses is never
+// started: it is driven by commands read from a script, stdin or a TCP
+// connection, and shows its screen as text dumps. Time only passes in
+// the commands that run the VT100:
+//
+//   wait MS		run for MS milliseconds
+//   expect MS TEXT	run until TEXT is on the screen, fail after MS
+//   type TEXT		type TEXT; \r \n \t \e and \\ are escapes
+//   key HEX		press the key with that keycode, 0x80 for Shift
+//   dump [FILE]	write the screen to FILE, else to the output
+//   line		write what went over the serial line so far
+//   quit
+//
+// Lines starting with # are comments. A failed command ends a script
+// with exit status 1; over a connection each command is answered with
+// "ok" or "fail" and a reason.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <string>
+#include <deque>
+#include "vt100sim.h"
+#include "simlog.h"
+#include "optionparser.h"
+#include "8080/simglb.h"
+
+int utf8_term = 0;
+
+static const int CPUHZ = 2764800;
+static const unsigned long long FRAME = 46084;	// cycles per vertical retrace
+
+option::ArgStatus checkNum(const option::Option& opt, bool msg) {
+  char* tail;
+  if (opt.arg == NULL) return option::ARG_ILLEGAL;
+  strtoul(opt.arg,&tail,10);
+  if (*tail != '\0' || tail == opt.arg) return option::ARG_ILLEGAL;
+  else return option::ARG_OK;
+}
+
+option::ArgStatus checkArg(const option::Option& opt, bool msg) {
+  return opt.arg && *opt.arg ? option::ARG_OK : option::ARG_ILLEGAL;
+}
+
+enum OptionIndex { UNKNOWN, HELP, SCRIPT, LISTEN, LOG, EXEC, FAST, NOAVO, NOSKIP, UNTHROTTLED, LINE };
+const option::Descriptor usage[] = {
+  { UNKNOWN, 0, "", "", option::Arg::None, "Usage: vt100headless [options] ROM.bin" },
+  { HELP, 0, "h", "help", option::Arg::None, "--help, -h\tPrint usage and exit" },
+  { SCRIPT, 0, "c", "script", checkArg, "--script, -c\tRead the commands from this file, - for stdin (the default)"},
+  { LISTEN, 0, "l", "listen", checkNum, "--listen, -l\tTake the commands from the first connection to this TCP port on localhost"},
+  { LOG, 0, "L", "log", checkArg, "--log, -L\tWrite the messages of the simulator to this file rather than stderr"},
+  { EXEC, 0, "e", "exec", checkArg, "--exec, -e\tProgram to run on the PTY instead of $SHELL"},
+  { FAST, 0, "f", "fast", option::Arg::None, "--fast, -f\tRun flat out rather than at the real speed"},
+  { NOAVO, 0, "N", "noavo", option::Arg::None, "--noavo, -N\tDisable AVO flag."},
+  { NOSKIP, 0, "S", "noskip", option::Arg::None, "--noskip, -S\tInterpret idle loops instead of skipping them."},
+  { UNTHROTTLED, 0, "U", "unthrottled", option::Arg::None, "--unthrottled, -U  \tGive the firmware each byte from the host as soon as it has taken the last, not at the line speed."},
+  { LINE, 0, "i", "line", checkArg, "--line, -i\tThe host on the serial line: pty (the default), pty:COMMAND, tcp:PORT, unix:PATH, stdio or file:PATH to replay"},
+  {0,0,0,0,0,0}
+};
+
+static Vt100Sim* vt;
+static bool fast;
+static std::deque<int> typeahead;	// for Vt100Sim::pressKey()
+static unsigned long long next_key;
+
+static void fileSink(void* ctx, const char* msg)
+{
+  fputs(msg, (FILE*)ctx);
+  fflush((FILE*)ctx);
+}
+
+// Press the next key once the keyboard has sent the last one, at most
+// one a frame like a typist on the curses screen
+static void feedKeys()
+{
+  if (typeahead.empty() || t_ticks < next_key || vt->kbd.busy_scanning())
+    return;
+  vt->pressKey(typeahead.front());
+  typeahead.pop_front();
+  next_key = t_ticks + FRAME;
+}
+
+// Run for the given cycles, or until done() says so; in real time
+// unless --fast. done() and the clock are looked at once a frame.
+static bool run(unsigned long long cycles, bool (*done)(const char*), const char* arg)
+{
+  const unsigned long long from = t_ticks, end = t_ticks + cycles;
+  unsigned long long frame = t_ticks;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (t_ticks < end && cpu_error == NONE) {
+    vt->runSlice();
+    feedKeys();
+    if (t_ticks < frame) continue;
+    frame = t_ticks + FRAME;
+    if (done && done(arg)) return true;
+    if (fast) continue;
+    long long nsec = (t_ticks - from) * 1000000000ULL / CPUHZ;
+    struct timespec until = start;
+    until.tv_sec += nsec / 1000000000;
+    until.tv_nsec += nsec % 1000000000;
+    if (until.tv_nsec >= 1000000000) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0) == EINTR)
+      ;
+  }
+  return done == NULL;
+}
+
+static void putUtf8(std::string& s, int u)
+{
+  if (u < 0x80) s += u;
+  else if (u < 0x800) {
+    s += 0xc0 | u >> 6;
+    s += 0x80 | (u & 0x3f);
+  } else {
+    s += 0xe0 | u >> 12;
+    s += 0x80 | ((u >> 6) & 0x3f);
+    s += 0x80 | (u & 0x3f);
+  }
+}
+
+// The screen as UTF-8 text, one line per row, without the attributes
+static std::string screenText()
+{
+  ScreenLine lines[ScreenLine::ROWS];
+  const int n = vt->readScreen(lines, ScreenLine::ROWS);
+  std::string text;
+  for (int y = 0; y < n; y++) {
+    std::string row;
+    for (int x = 0; x < lines[y].len; x++) {
+      const int c = lines[y].ch[x] & 0x7f;
+      if (c == 0 || c == 127) row += ' ';
+      else if (c < 32) putUtf8(row, xterm_chars[c-1]);
+      else row += c;
+      if (lines[y].lattr != 3) row += ' ';
+    }
+    row.erase(row.find_last_not_of(' ') + 1);
+    text += row + '\n';
+  }
+  return text;
+}
+
+static bool onScreen(const char* text)
+{
+  return screenText().find(text) != std::string::npos;
+}
+
+// Queue the keys of text; false on a bad escape
+static bool typeText(const char* text)
+{
+  for (const char* p = text; *p; p++) {
+    int c = (unsigned char)*p;
+    if (c == '\\' && p[1]) {
+      switch (*++p) {
+      case 'r': c = '\r'; break;
+      case 'n': c = '\n'; break;
+      case 't': c = '\t'; break;
+      case 'e': c = 27; break;
+      case '\\': c = '\\'; break;
+      default: return false;
+      }
+    }
+    typeahead.push_back(c);
+  }
+  return true;
+}
+
+// Run one command line; false with why set if it failed
+static bool command(char* line, FILE* out, std::string& why)
+{
+  char* arg = line + strcspn(line, " \t");
+  if (*arg) *arg++ = '\0';
+  arg += strspn(arg, " \t");
+  char* tail;
+  if (!strcmp(line, "wait")) {
+    unsigned long ms = strtoul(arg, &tail, 10);
+    if (tail == arg || *tail) { why = "bad time"; return false; }
+    run(ms * CPUHZ / 1000, NULL, NULL);
+  } else if (!strcmp(line, "expect")) {
+    unsigned long ms = strtoul(arg, &tail, 10);
+    if (tail == arg || (*tail != ' ' && *tail != '\t')) { why = "bad time"; return false; }
+    tail += strspn(tail, " \t");
+    if (!onScreen(tail) && !run(ms * CPUHZ / 1000, onScreen, tail)) {
+      why = std::string("no \"") + tail + "\" on the screen";
+      return false;
+    }
+  } else if (!strcmp(line, "type")) {
+    if (!typeText(arg)) { why = "bad escape"; return false; }
+  } else if (!strcmp(line, "key")) {
+    unsigned long kc = strtoul(arg, &tail, 16);
+    if (tail == arg || *tail || kc > 0xff) { why = "bad keycode"; return false; }
+    typeahead.push_back(Vt100Sim::KEYCODE | kc);
+  } else if (!strcmp(line, "line")) {
+    const PUSART::LineStats ls = vt->uart.line_stats(t_ticks);
+    fprintf(out, "%llu bytes in, %llu XOFFs, %llu ms held off, %llu overruns\n",
+	    ls.rx_bytes, ls.xoffs, ls.xoff_cycles * 1000 / CPUHZ, ls.overruns);
+  } else if (!strcmp(line, "dump")) {
+    const std::string text = screenText();
+    FILE* fp = *arg ? fopen(arg, "w") : out;
+    if (fp == NULL) { why = strerror(errno); return false; }
+    fputs(text.c_str(), fp);
+    if (fp != out && fclose(fp) != 0) { why = strerror(errno); return false; }
+  } else {
+    why = std::string("unknown command ") + line;
+    return false;
+  }
+  if (cpu_error != NONE) { why = "CPU stopped"; return false; }
+  return true;
+}
+
+// Take the commands from in until EOF or quit. Over a connection every
+// command gets its answer, a script stops at the first failure.
+static int serve(FILE* in, FILE* out, bool answer)
+{
+  char buf[1024];
+  int lineno = 0;
+  while (fgets(buf, sizeof(buf), in) != NULL) {
+    lineno++;
+    buf[strcspn(buf, "\r\n")] = '\0';
+    char* line = buf + strspn(buf, " \t");
+    if (*line == '\0' || *line == '#') continue;
+    if (!strcmp(line, "quit")) break;
+    std::string why;
+    const bool ok = command(line, out, why);
+    if (answer) {
+      if (ok) fprintf(out, "ok\n");
+      else fprintf(out, "fail %s\n", why.c_str());
+      fflush(out);
+    } else if (!ok) {
+      fprintf(stderr, "vt100headless: line %d: %s\n", lineno, why.c_str());
+      return 1;
+    }
+  }
+  fflush(out);
+  return 0;
+}
+
+static int listenOn(int port)
+{
+  struct sockaddr_in sa;
+  int one = 1, s, c;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+      setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+      bind(s, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(s, 1) < 0) {
+    perror("vt100headless");
+    return -1;
+  }
+  while ((c = accept(s, NULL, NULL)) < 0 && errno == EINTR)
+    ;
+  if (c < 0) perror("vt100headless");
+  close(s);
+  return c;
+}
+
+int main(int argc, char *argv[])
+{
+  argc-=(argc>0); argv+=(argc>0); // skip program name argv[0] if present
+  option::Stats  stats(usage, argc, argv);
+  option::Option options[stats.options_max], buffer[stats.buffer_max];
+  option::Parser parse(usage, argc, argv, options, buffer);
+  if (parse.error()) return 1;
+  if (options[HELP] || argc == 0) {
+    option::printUsage(std::cout, usage);
+    return 0;
+  }
+  if (parse.nonOptionsCount() < 1) {
+    std::cout << "No ROM specified"; return 1;
+  }
+  HostLine* line = NULL;
+  if (options[LINE] && (line = HostLine::create(options[LINE].arg)) == NULL) {
+    std::cout << "Bad line " << options[LINE].arg << "\n"; return 1;
+  }
+  // On stdio the commands have to come from elsewhere
+  if (options[LINE] && !strcmp(options[LINE].arg, "stdio") && !options[LISTEN] &&
+      (!options[SCRIPT] || !strcmp(options[SCRIPT].arg, "-"))) {
+    std::cout << "The stdio line needs --script FILE or --listen\n"; return 1;
+  }
+  fast = options[FAST];
+  if (options[EXEC]) setenv("SHELL", options[EXEC].arg, 1);
+  FILE* log = NULL;
+  if (options[LOG]) {
+    if ((log = fopen(options[LOG].arg, "a")) == NULL) {
+      perror(options[LOG].arg); return 1;
+    }
+    setLogSink(fileSink, log);
+  }
+
+  FILE *in = stdin, *out = stdout;
+  if (options[LISTEN]) {
+    int c = listenOn(atoi(options[LISTEN].arg));
+    if (c < 0) return 1;
+    in = fdopen(c, "r");
+    out = fdopen(dup(c), "w");
+  } else if (options[SCRIPT] && strcmp(options[SCRIPT].arg, "-")) {
+    if ((in = fopen(options[SCRIPT].arg, "r")) == NULL) {
+      perror(options[SCRIPT].arg); return 1;
+    }
+  }
+
+  vt = new Vt100Sim(parse.nonOptions()[0],true,!options[NOAVO],false);
+  vt->init();
+  vt->setIdleSkip(!options[NOSKIP]);
+  vt->uart.set_unthrottled(options[UNTHROTTLED]);
+  if (line) vt->uart.set_line(line);
+  int status = serve(in, out, options[LISTEN]);
+  delete vt;
+  if (log) fclose(log);
+  return status;
+}
@@ -0,0 +1,267 @@
+#include "hostline.h"
+#include "simlog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+HostLine::HostLine() : in_fd(-1), out_fd(-1), listen_fd(-1)
+{
+}
+
+HostLine::~HostLine()
+{
+}
+
+bool HostLine::hangup()
+{
+  if (in_fd != -1) close(in_fd);
+  if (out_fd != -1 && out_fd != in_fd) close(out_fd);
+  in_fd = out_fd = -1;
+  return false;
+}
+
+static void nonBlocking(int fd)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+  fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// A program on a fresh PTY: the command given, run by /bin/sh, else
+// $SHELL; started again after a hang-up
+class PtyLine : public HostLine {
+public:
+  PtyLine(const char* command) : command(command) {}
+  ~PtyLine() { hangup(); }
+  bool start();
+private:
+  std::string command;
+};
+
+bool PtyLine::start() {
+  hangup();
+
+  int pty_fd = posix_openpt( O_RDWR | O_NOCTTY );
+  if (pty_fd < 0) {
+    simLog("No PTY: %s\n", strerror(errno));
+    return false;
+  }
+  grantpt(pty_fd);
+  unlockpt(pty_fd);
+  nonBlocking(pty_fd);
+
+  struct termios config;
+  struct termios orig_settings;
+
+  if(!isatty(pty_fd)) {}
+
+  int fds = open(ptsname(pty_fd), O_RDWR);
+  if(tcgetattr(fds, &orig_settings) < 0) {}
+
+  if(tcgetattr(pty_fd, &config) < 0) {}
+  config.c_iflag &= ~(IGNBRK | BRKINT | ICRNL |
+		      INLCR | PARMRK | INPCK | ISTRIP | IXON);
+  config.c_oflag = 0;
+  config.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+  config.c_cflag &= ~(CSIZE | PARENB);
+  config.c_cflag |= CS8;
+  config.c_cc[VMIN]  = 1;
+  config.c_cc[VTIME] = 0;
+  if(tcsetattr(pty_fd, TCSAFLUSH, &config) < 0) {}
+
+  int pid = fork();
+
+  if (pid == 0) {
+    // Child process.
+    close(pty_fd);  // Close master
+
+    config = orig_settings;
+    config.c_iflag &= ~(IGNBRK | BRKINT | ICRNL |
+			INLCR | PARMRK | INPCK | ISTRIP | IXON);
+    config.c_oflag = 0;
+    config.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+    config.c_cflag &= ~(CSIZE | PARENB);
+    config.c_cflag |= CS8;
+    config.c_cc[VMIN]  = 1;
+    config.c_cc[VTIME] = 0;
+    if(tcsetattr(fds, TCSANOW, &config) < 0) {}
+
+    // Reopen stdio to slave pty.
+    close(0); close(1); close(2);
+    dup(fds); dup(fds); dup(fds);
+
+    setsid();
+    ioctl(0, TIOCSCTTY, 1);
+    if(tcsetattr(fds, TCSANOW, &orig_settings) < 0) {}
+    close(fds);
+
+    /* The VT100 is not multi language */
+    unsetenv("LANG");
+    setenv("TERM", "vt100", 1);
+
+    if (!command.empty())
+      execl("/bin/sh", "/bin/sh", "-c", command.c_str(), (char*)0);
+    char * shell = getenv("SHELL");
+    if (shell && *shell)
+      execl(shell, shell, (char*)0);
+    execl("/bin/sh", "/bin/sh", (char*)0);
+
+    exit(128);
+  }
+
+  // Don't need the slave here
+  close(fds);
+
+  line_name = ptsname(pty_fd);
+  in_fd = out_fd = pty_fd;
+  return true;
+}
+
+// A socket on localhost, TCP or Unix, taking one host at a time; the
+// next may connect when that one is gone
+class ListenLine : public HostLine {
+public:
+  ListenLine(int port) : port(port) {}
+  ListenLine(const char* path) : port(-1), path(path) {}
+  ~ListenLine();
+  bool start();
+  bool hangup();
+  void accept();
+private:
+  int port;			// -1 for a Unix socket at path
+  std::string path;
+};
+
+ListenLine::~ListenLine() {
+  hangup();
+  if (listen_fd != -1) {
+    close(listen_fd);
+    if (port == -1) unlink(path.c_str());
+  }
+}
+
+bool ListenLine::start() {
+  if (listen_fd != -1) return true;
+  struct sockaddr_in sin;
+  struct sockaddr_un sun;
+  struct sockaddr* sa;
+  socklen_t len;
+  int one = 1;
+  if (port != -1) {
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(port);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa = (struct sockaddr*)&sin;
+    len = sizeof(sin);
+  } else {
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(sun.sun_path)) {
+      simLog("Socket path too long: %s\n", path.c_str());
+      return false;
+    }
+    strcpy(sun.sun_path, path.c_str());
+    unlink(path.c_str());
+    sa = (struct sockaddr*)&sun;
+    len = sizeof(sun);
+  }
+  int s = socket(sa->sa_family, SOCK_STREAM, 0);
+  if (s < 0 ||
+      (port != -1 && setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0) ||
+      bind(s, sa, len) < 0 || listen(s, 1) < 0) {
+    simLog("Cannot listen on %s: %s\n", line_name.c_str(), strerror(errno));
+    if (s >= 0) close(s);
+    return false;
+  }
+  nonBlocking(s);
+  listen_fd = s;
+  return true;
+}
+
+bool ListenLine::hangup() {
+  HostLine::hangup();
+  return listen_fd != -1;
+}
+
+void ListenLine::accept() {
+  int c = ::accept(listen_fd, NULL, NULL);
+  if (c < 0) return;
+  nonBlocking(c);
+  in_fd = out_fd = c;
+}
+
+// The standard input and output of the simulator, for a host at the
+// other end of a pipe
+class PipeLine : public HostLine {
+public:
+  bool start();
+  bool hangup();
+};
+
+bool PipeLine::start() {
+  nonBlocking(0);
+  nonBlocking(1);
+  in_fd = 0;
+  out_fd = 1;
+  return true;
+}
+
+bool PipeLine::hangup() {
+  in_fd = out_fd = -1;	// not ours to close
+  return false;
+}
+
+// The bytes of a file, as fast as the line takes them; what the VT100
+// sends is dropped. After the end the next start() plays it again.
+class FileLine : public HostLine {
+public:
+  FileLine(const char* path) : path(path) {}
+  ~FileLine() { hangup(); }
+  bool start();
+private:
+  std::string path;
+};
+
+bool FileLine::start() {
+  hangup();
+  in_fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+  if (in_fd < 0) {
+    simLog("Cannot open %s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  out_fd = open("/dev/null", O_WRONLY | O_NONBLOCK);
+  return true;
+}
+
+HostLine* HostLine::create(const char* spec)
+{
+  const char* arg = strchr(spec, ':');
+  const std::string kind(spec, arg ? arg - spec : strlen(spec));
+  HostLine* line;
+  if (arg) arg++;
+  if (kind == "pty")
+    line = new PtyLine(arg ? arg : "");
+  else if (kind == "tcp" && arg && *arg) {
+    char* tail;
+    unsigned long port = strtoul(arg, &tail, 10);
+    if (*tail || port == 0 || port > 65535) return NULL;
+    line = new ListenLine((int)port);
+  } else if (kind == "unix" && arg && *arg)
+    line = new ListenLine(arg);
+  else if (kind == "stdio" && !arg)
+    line = new PipeLine;
+  else if (kind == "file" && arg && *arg)
+    line = new FileLine(arg);
+  else
+    return NULL;
+  line->line_name = spec;
+  return line;
+}
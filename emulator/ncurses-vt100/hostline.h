@@ -0,0 +1,30 @@
+#ifndef HOSTLINE_H
+#define HOSTLINE_H
+
+#include <string>
+
+// The host end of the serial line of the PUSART. start() gets it going
+// and sets the descriptors the I/O thread of the PUSART reads the host
+// from and writes it to; see PUSART::ioThread(). They are non-blocking.
+class HostLine {
+public:
+  HostLine();
+  virtual ~HostLine();
+  // Get the line going; false if it cannot be
+  virtual bool start() = 0;
+  // The host is gone, or the PUSART is done with it: close this end.
+  // True if another host can come, on listen_fd.
+  virtual bool hangup();
+  // Take the host waiting on listen_fd
+  virtual void accept() {}
+  const char* name() { return line_name.c_str(); }
+  int in_fd, out_fd;		// -1 while there is no host
+  int listen_fd;		// where hosts come, -1 if none do
+  // Make one from a spec: pty, pty:COMMAND, tcp:PORT, unix:PATH,
+  // stdio or file:PATH; NULL if spec is none of them
+  static HostLine* create(const char* spec);
+protected:
+  std::string line_name;
+};
+
+#endif // HOSTLINE_H
@@ -2,9 +2,10 @@
 #include <stdio.h>
 #include "8080/sim.h"
 #include "8080/simglb.h"
+#include "simlog.h"
 #include <ncurses.h>
 
-Keyboard::Keyboard() : state(KBD_IDLE), latch(0)
+Keyboard::Keyboard() : state(KBD_IDLE), latch(0), tx_buf_count(0)
 {
     scan_iter = scan.end();
 }
@@ -16,8 +17,6 @@ uint8_t Keyboard::get_latch()
 
 bool Keyboard::get_tx_buf_empty() { return !tx_buf_count; }
 
-extern WINDOW* msgWin;
-
 /*
  * The VT100 triggers keyboard scans by setting bit (1<<6) in the status.
  * It then expects to receive one or more scan codes followed by an 0x7F
@@ -49,7 +48,7 @@ void Keyboard::set_status(uint8_t status)
     //printf("Got kbd status %02x at %04x\n",status,PC-ram); fflush(stdout);
     if ((status & (1<<6)) &&  state == KBD_IDLE) {
         //printf("SCAN START\n");fflush(stdout);
-      //wprintw(msgWin,"Scan start\n");wrefresh(msgWin);
+      //simLog("Scan start\n");
         state = KBD_SENDING;
 
 	// NB: Time for the status to be received + time for the reply.
@@ -69,6 +68,19 @@ void Keyboard::keypress(uint8_t keycode)
     keys.insert(keycode);
 }
 
+uint32_t Keyboard::clocks_to_interrupt()
+{
+    switch (state) {
+    case KBD_SENDING:
+	// No interrupt on the switch to responding, but the delay after
+	// it depends on the scan so stop there.
+    case KBD_RESPONDING:
+	return clocks_until_next + 1;
+    default:
+	return 0;
+    }
+}
+
 bool Keyboard::clock(bool rising)
 {
     if (!rising) { return false; }
@@ -124,7 +136,7 @@ bool Keyboard::clock(bool rising)
     case KBD_RESPONDING:
         if (clocks_until_next == 0) {
             if (scan_iter != scan.end()) {
-	      //wprintw(msgWin,"Sending %02x\n",*scan_iter);wrefresh(msgWin);
+	      //simLog("Sending %02x\n",*scan_iter);
 	      //printf("SENDING KEY %02x\n",*scan_iter);fflush(stdout);
                 clocks_until_next = 160;
                 latch = *scan_iter;
@@ -132,7 +144,7 @@ bool Keyboard::clock(bool rising)
             } else {
                 latch = 0x7f;
                 state = KBD_IDLE;
-		//wprintw(msgWin,"End scan\n");wrefresh(msgWin);
+		//simLog("End scan\n");
             }
             return true;
         }
@@ -140,7 +152,7 @@ bool Keyboard::clock(bool rising)
         return false;
         break;
     default:
-      wprintw(msgWin,"Bad state\n");wrefresh(msgWin);
+      simLog("Bad state\n");
       
     }
     return false;
@@ -36,6 +36,12 @@ public:
     // Gets a clock for LBA4
     bool clock(bool rising); // return true if an interrupt is generated
     bool busy_scanning() { return !keys.empty(); }
+    // True if clock() would do nothing; LBA4 edges may be skipped
+    bool idle() { return state == KBD_IDLE && tx_buf_count == 0; }
+    // Rising clocks before clock() can next interrupt (0: never)
+    uint32_t clocks_to_interrupt();
+    // Rising clocks before get_tx_buf_empty() turns true (0: it is)
+    uint32_t clocks_to_tx_empty() { return tx_buf_count; }
 };
 
 #endif // KEYBOARD_H
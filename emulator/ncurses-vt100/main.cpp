@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
 #include <iostream>
 #include "vt100sim.h"
 #include "optionparser.h"
@@ -17,13 +19,31 @@ option::ArgStatus checkBP(const option::Option& opt, bool msg) {
   else return option::ARG_OK;
 }
 
-enum OptionIndex { UNKNOWN, HELP, RUN, BREAKPOINT, NOAVO };
+option::ArgStatus checkNum(const option::Option& opt, bool msg) {
+  char* tail;
+  if (opt.arg == NULL) return option::ARG_ILLEGAL;
+  strtoul(opt.arg,&tail,10);
+  if (*tail != '\0' || tail == opt.arg) return option::ARG_ILLEGAL;
+  else return option::ARG_OK;
+}
+
+option::ArgStatus checkArg(const option::Option& opt, bool msg) {
+  return opt.arg && *opt.arg ? option::ARG_OK : option::ARG_ILLEGAL;
+}
+
+enum OptionIndex { UNKNOWN, HELP, RUN, BREAKPOINT, WATCH, NOAVO, BENCH, NOSKIP, HISTORY, UNTHROTTLED, LINE };
 const option::Descriptor usage[] = {
   { UNKNOWN, 0, "", "", option::Arg::None, "Usage: vt100sim [options] ROM.bin" },
   { HELP, 0, "h", "help", option::Arg::None, "--help, -h\tPrint usage and exit" },
   { RUN, 0, "r", "run", option::Arg::None, "--run, -r\tImmediately run at startup"},
   { BREAKPOINT, 0, "b", "break", checkBP, "--break, -b\tInsert breakpoint"},
+  { WATCH, 0, "w", "watch", checkBP, "--watch, -w\tStop when the byte at this address changes"},
   { NOAVO, 0, "N", "noavo", option::Arg::None, "--noavo, -b\tDisable AVO flag."},
+  { BENCH, 0, "B", "bench", checkNum, "--bench, -B\tRun N million cycles flat out, report MIPS and exit"},
+  { NOSKIP, 0, "S", "noskip", option::Arg::None, "--noskip, -S\tInterpret idle loops instead of skipping them."},
+  { HISTORY, 0, "H", "history", checkNum, "--history, -H\tRecord the registers at the last N opcodes, for the trace at a breakpoint."},
+  { UNTHROTTLED, 0, "U", "unthrottled", option::Arg::None, "--unthrottled, -U  \tGive the firmware each byte from the host as soon as it has taken the last, not at the line speed."},
+  { LINE, 0, "i", "line", checkArg, "--line, -i\tThe host on the serial line: pty (the default), pty:COMMAND, tcp:PORT, unix:PATH, stdio or file:PATH to replay"},
   {0,0,0,0,0,0}
 };
 
@@ -47,12 +67,43 @@ int main(int argc, char *argv[])
   if (parse.nonOptionsCount() < 1) {
     std::cout << "No ROM specified"; return 1;
   }
+  HostLine* line = NULL;
+  // stdio is the terminal of the curses screen here
+  if (options[LINE] && ((line = HostLine::create(options[LINE].arg)) == NULL ||
+			!strcmp(options[LINE].arg, "stdio"))) {
+    std::cout << "Bad line " << options[LINE].arg << "\n"; return 1;
+  }
   sim = new Vt100Sim(parse.nonOptions()[0],running,!options[NOAVO]);
   sim->init();
+  sim->setIdleSkip(!options[NOSKIP]);
+  sim->uart.set_unthrottled(options[UNTHROTTLED]);
+  if (line) sim->uart.set_line(line);
+  if (options[HISTORY] && !sim->setHistory(strtoul(options[HISTORY].arg,NULL,10))) {
+    delete sim;
+    std::cout << "No room for the history\n"; return 1;
+  }
   for (option::Option* bpo = options[BREAKPOINT]; bpo != NULL; bpo = bpo->next()) {
     unsigned int bp = strtoul(bpo->arg,NULL,16);
     sim->addBP(bp);
   }
+  for (option::Option* wpo = options[WATCH]; wpo != NULL; wpo = wpo->next()) {
+    sim->addWatch(strtoul(wpo->arg,NULL,16));
+  }
+
+  if (options[BENCH]) {
+    const int CPUHZ = 2764800;
+    unsigned long long cycles = strtoull(options[BENCH].arg,NULL,10) * 1000000ULL;
+    clock_t start = clock();
+    long instructions = sim->bench(cycles);
+    double secs = (clock() - start) / (double)CLOCKS_PER_SEC;
+    double skipped = sim->idleSkipped() * 100.0 / cycles;
+    delete sim;
+    fprintf(stderr, "%llu cycles, %ld instructions in %.3f s CPU: %.2f MIPS, %.1fx real time\n",
+	   cycles, instructions, secs, instructions / secs / 1e6,
+	   cycles / (double)CPUHZ / secs);
+    fprintf(stderr, "%.1f%% of the cycles skipped in idle loops\n", skipped);
+    return 0;
+  }
 
   sim->run();
   delete sim;
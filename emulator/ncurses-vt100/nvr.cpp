@@ -1,6 +1,6 @@
 #include "nvr.h"
 #include <stdio.h>
-#include <ncurses.h>
+#include "simlog.h"
 
 /*
  * The NVRAM is 1400 bit 'flash' device with 100 14-bit words.
@@ -24,8 +24,6 @@ typedef enum {
     UNUSED = 0b011
 } Commands;
 
-extern WINDOW* msgWin;
-
 uint16_t romcontents[100] = {
 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80,
 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80, 0x2e80,
@@ -88,7 +86,7 @@ void NVR::clock(bool rising) {
     {
         uint8_t addr = compute_addr(address_reg);
         contents[addr] = data_reg & 0x3fff;
-        //wprintw(msgWin,"NVR write %x <- %x\n",addr,data_reg);wrefresh(msgWin);
+        //simLog("NVR write %x <- %x\n",addr,data_reg);
 	save( (char*) /* CPP is Dumb */ "/tmp/vt100.nvr");
     }
         break;
@@ -96,7 +94,7 @@ void NVR::clock(bool rising) {
     {
         uint8_t addr = compute_addr(address_reg);
         data_reg = contents[addr];
-        //wprintw(msgWin,"NVR read  %x -> %x\n",addr,data_reg);wrefresh(msgWin);
+        //simLog("NVR read  %x -> %x\n",addr,data_reg);
     }
         break;
     case SHIFT_OUT:
@@ -108,6 +106,11 @@ void NVR::clock(bool rising) {
     }
 }
 
+bool NVR::idle() {
+    uint8_t command = (latch_last>>1) & 0b111;
+    return command == STANDBY || command == UNUSED;
+}
+
 bool NVR::data() {
     return out;
 }
@@ -12,6 +12,8 @@ public:
     void set_latch(uint8_t latch);
     bool data();
     void clock(bool rising);
+    // True if clock() would do nothing; LBA7 edges may be skipped
+    bool idle();
 
     // persistence
     void load(char* path);
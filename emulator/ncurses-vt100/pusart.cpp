@@ -1,99 +1,233 @@
 #include "pusart.h"
 #include <stdlib.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <iostream>
-#include <termios.h>
-#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <errno.h>
+
+static const unsigned long CPU_HZ = 2764800;
+
+// Speeds of the baud rate generator (port 0x02), in tenths of a baud
+static const unsigned long speeds[16] = {
+  500, 750, 1100, 1345, 1500, 2000, 3000, 6000,
+  12000, 18000, 20000, 24000, 36000, 48000, 96000, 192000
+};
 
 PUSART::PUSART() : 
   mode_select_mode(true),
   has_xmit_ready(true),
   mode(0),
   command(0),
-  pty_fd(-1),
-  has_rx_rdy(false)
+  line(NULL),
+  has_rx_rdy(false),
+  xoff(false),
+  xoff_since(0),
+  stats(),
+  rx_in(0),
+  rx_out(0),
+  rx_full(false),
+  tx_in(0),
+  tx_flushed(0),
+  tx_out(0),
+  hung_up(false),
+  wake_fd(-1),
+  io_quit(false),
+  speed(0xee),
+  half_bits(20),
+  unthrottled(false),
+  tx_hold_at(0),
+  tx_idle_at(0)
 {
+  pthread_mutex_init(&tx_mutex, NULL);
+}
+
+PUSART::~PUSART() {
+  stopIO();
+  delete line;
+  pthread_mutex_destroy(&tx_mutex);
+}
+
+void PUSART::set_line(HostLine* l) {
+  stopIO();
+  delete line;
+  line = l;
+}
+
+// Get the line going, a PTY with $SHELL unless set_line() gave another,
+// and the I/O thread on it
+void PUSART::start_line() {
+  stopIO();
+  if (line == NULL) line = HostLine::create("pty");
+  if (!line->start()) return;
+  wake_fd = eventfd(0, EFD_NONBLOCK);
+  pthread_create(&io_thread, NULL, ioThreadCB, this);
+}
+
+void* PUSART::ioThreadCB(void* ctx) {
+  ((PUSART*)ctx)->ioThread();
+  return NULL;
 }
 
-void PUSART::start_shell() {
-  if (pty_fd != -1) close(pty_fd);
-
-  pty_fd = posix_openpt( O_RDWR | O_NOCTTY );
-  grantpt(pty_fd);
-  unlockpt(pty_fd);
-  int flags = fcntl(pty_fd, F_GETFL, 0);
-  fcntl(pty_fd, F_SETFL, flags | O_NONBLOCK);
-
-  struct termios config;
-  struct termios orig_settings;
-
-  if(!isatty(pty_fd)) {}
-
-  int fds = open(ptsname(pty_fd), O_RDWR);
-  if(tcgetattr(fds, &orig_settings) < 0) {}
-
-  if(tcgetattr(pty_fd, &config) < 0) {}
-  config.c_iflag &= ~(IGNBRK | BRKINT | ICRNL |
-		      INLCR | PARMRK | INPCK | ISTRIP | IXON);
-  config.c_oflag = 0;
-  config.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
-  config.c_cflag &= ~(CSIZE | PARENB);
-  config.c_cflag |= CS8;
-  config.c_cc[VMIN]  = 1;
-  config.c_cc[VTIME] = 0;
-  if(tcsetattr(pty_fd, TCSAFLUSH, &config) < 0) {}
-
-  int pid = fork();
-
-  if (pid == 0) {
-    // Child process.
-    close(pty_fd);  // Close master
-
-    config = orig_settings;
-    config.c_iflag &= ~(IGNBRK | BRKINT | ICRNL |
-			INLCR | PARMRK | INPCK | ISTRIP | IXON);
-    config.c_oflag = 0;
-    config.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
-    config.c_cflag &= ~(CSIZE | PARENB);
-    config.c_cflag |= CS8;
-    config.c_cc[VMIN]  = 1;
-    config.c_cc[VTIME] = 0;
-    if(tcsetattr(fds, TCSANOW, &config) < 0) {}
-
-    // Reopen stdio to slave pty.
-    close(0); close(1); close(2);
-    dup(fds); dup(fds); dup(fds);
-
-    setsid();
-    ioctl(0, TIOCSCTTY, 1);
-    if(tcsetattr(fds, TCSANOW, &orig_settings) < 0) {}
-    close(fds);
-
-    /* The VT100 is not multi language */
-    unsetenv("LANG");
-    setenv("TERM", "vt100", 1);
-
-    char * shell = getenv("SHELL");
-    if (shell && *shell)
-      execl(shell, shell, 0);
-    execl("/bin/sh", "/bin/sh", 0);
-
-    exit(128);
+// Move the bytes between the host and the rings, as many as there are
+// or there is room for at a time: read what the host sends into
+// rx_buf, and write what flush() handed over.
+// Once rx_buf is full, wait until clock() has taken it down to RX_LOW,
+// rather than reading the line again for every byte taken; and while
+// the VT100 has sent XOFF, leave what the host sends to back up in the
+// line until XON. On a short write
+// or EAGAIN the rest waits for the host to take more. When the host
+// hangs up the thread waits for the next on the listen_fd of the line,
+// if it has one, else it ends; as it does on stopIO().
+void PUSART::ioThread() {
+  struct pollfd fds[3];
+  bool hup = false;
+  fds[2].fd = wake_fd;
+  fds[2].events = POLLIN;
+  while (!__atomic_load_n(&io_quit, __ATOMIC_ACQUIRE)) {
+    unsigned room = RX_SIZE - (rx_in - __atomic_load_n(&rx_out, __ATOMIC_SEQ_CST));
+    if (room == 0) {
+      __atomic_store_n(&rx_full, true, __ATOMIC_SEQ_CST);
+      room = RX_SIZE - (rx_in - __atomic_load_n(&rx_out, __ATOMIC_SEQ_CST));
+      if (room >= RX_SIZE - RX_LOW) __atomic_store_n(&rx_full, false, __ATOMIC_RELAXED);
+      else room = 0;
+    }
+    pthread_mutex_lock(&tx_mutex);
+    unsigned queued = tx_flushed - tx_out;
+    if (line->out_fd == -1) {
+      // Nobody there: what the VT100 sends is lost
+      __atomic_store_n(&tx_out, tx_flushed, __ATOMIC_RELEASE);
+      queued = 0;
+    }
+    pthread_mutex_unlock(&tx_mutex);
+    // poll() skips a negative fd. Once the host has hung up it is only
+    // read until the rest of what it sent is in rx_buf.
+    if (line->in_fd == -1) {
+      fds[0].fd = line->listen_fd;
+      fds[0].events = POLLIN;
+    } else {
+      fds[0].fd = room && !__atomic_load_n(&xoff, __ATOMIC_ACQUIRE) ? line->in_fd : -1;
+      fds[0].events = POLLIN;
+    }
+    fds[1].fd = queued && !hup ? line->out_fd : -1;
+    fds[1].events = POLLOUT;
+    if (poll(fds, 3, -1) < 0) continue;
+    if (fds[2].revents & POLLIN) {
+      uint64_t n;
+      if (read(wake_fd, &n, sizeof(n)) < 0) {}
+    }
+    if (line->in_fd == -1) {
+      if (fds[0].revents & POLLIN) {
+	pthread_mutex_lock(&tx_mutex);
+	line->accept();
+	pthread_mutex_unlock(&tx_mutex);
+      }
+      continue;
+    }
+    hup = hup || ((fds[0].revents | fds[1].revents) & POLLHUP);
+    bool up = true;
+    ssize_t n;
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      const unsigned at = rx_in % RX_SIZE;
+      n = read(line->in_fd, rx_buf + at, room < RX_SIZE - at ? room : RX_SIZE - at);
+      if (n > 0)
+	__atomic_store_n(&rx_in, rx_in + n, __ATOMIC_RELEASE);
+      else
+	up = n < 0 && (errno == EAGAIN || errno == EINTR);
+    }
+    if (up && (fds[1].revents & (POLLOUT | POLLERR))) {
+      const unsigned at = tx_out % TX_SIZE;
+      n = write(line->out_fd, tx_buf + at, queued < TX_SIZE - at ? queued : TX_SIZE - at);
+      if (n > 0) {
+	pthread_mutex_lock(&tx_mutex);
+	__atomic_store_n(&tx_out, tx_out + n, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&tx_mutex);
+      } else
+	up = n == 0 || errno == EAGAIN || errno == EINTR;
+    }
+    if (up) continue;
+    pthread_mutex_lock(&tx_mutex);
+    const bool next = line->hangup();
+    pthread_mutex_unlock(&tx_mutex);
+    if (!next) break;
+    hup = false;
   }
+  __atomic_store_n(&hung_up, true, __ATOMIC_RELEASE);
+}
 
-  // Don't need the slave here
-  close(fds);
+void PUSART::wake() {
+  uint64_t one = 1;
+  if (write(wake_fd, &one, sizeof(one)) < 0) {}
 }
 
-bool PUSART::xmit_ready() { return has_xmit_ready; }
+// End the I/O thread and drop what it read but clock() did not take,
+// or was to write
+void PUSART::stopIO() {
+  if (wake_fd == -1) return;
+  __atomic_store_n(&io_quit, true, __ATOMIC_RELEASE);
+  wake();
+  pthread_join(io_thread, NULL);
+  close(wake_fd);
+  wake_fd = -1;
+  io_quit = rx_full = hung_up = false;
+  rx_in = rx_out = 0;
+  tx_in = tx_flushed = tx_out = 0;
+}
+
+// Write the bytes write_data() queued, or hand them to the I/O thread
+// if it has some left over from before, or the host does not take them
+// all. Only the thread writes while it has any.
+void PUSART::flush() {
+  if (tx_flushed == tx_in || wake_fd == -1) return;
+  pthread_mutex_lock(&tx_mutex);
+  bool left = tx_out != tx_flushed;
+  if (!left && line->out_fd == -1)
+    __atomic_store_n(&tx_out, tx_in, __ATOMIC_RELEASE);
+  else if (!left) {
+    const unsigned at = tx_out % TX_SIZE, queued = tx_in - tx_out;
+    ssize_t n = write(line->out_fd, tx_buf + at, queued < TX_SIZE - at ? queued : TX_SIZE - at);
+    if (n > 0)
+      __atomic_store_n(&tx_out, tx_out + n, __ATOMIC_RELEASE);
+    else if (n < 0 && errno != EAGAIN && errno != EINTR)
+      __atomic_store_n(&hung_up, true, __ATOMIC_RELEASE);
+    left = tx_out != tx_in;
+  }
+  tx_flushed = tx_in;
+  pthread_mutex_unlock(&tx_mutex);
+  if (left) wake();
+}
+
+bool PUSART::xmit_ready(unsigned long long now) {
+  return has_xmit_ready && now >= tx_hold_at &&
+    tx_in - __atomic_load_n(&tx_out, __ATOMIC_ACQUIRE) < TX_SIZE;
+}
+
+unsigned long long PUSART::xmit_ready_at() { return tx_hold_at; }
+
+// Cycles a character takes on the line at the given speed: the start
+// bit, the data bits, parity and the stop bits of the mode byte
+unsigned long PUSART::char_time(uint8_t code) {
+  return CPU_HZ * half_bits * 5 / speeds[code & 0x0f];
+}
+
+unsigned long PUSART::rx_time() {
+  return unthrottled ? 0 : char_time(speed >> 4);
+}
+
+void PUSART::write_speed(uint8_t b) { speed = b; }
+
+void PUSART::set_unthrottled(bool on) { unthrottled = on; }
 
 void PUSART::write_command(uint8_t cmd) {
   if (mode_select_mode) {
     mode_select_mode = false;
-    mode = cmd; // like we give a wet turd
-    if (pty_fd == -1)
-	start_shell();
+    mode = cmd;
+    // Asynchronous modes only: bits 2-3 are 5 to 8 data bits, bit 4
+    // parity and bits 6-7 1, 1.5 or 2 stop bits
+    if (mode & 0x03)
+      half_bits = 2 * (1 + 5 + (mode >> 2 & 3) + (mode >> 4 & 1)) +
+	((mode >> 6) ? (mode >> 6) + 1 : 2);
+    if (wake_fd == -1)
+      start_line();
   } else {
     command = cmd;
     if (cmd & 1<<6) { // INTERNAL RESET
@@ -104,13 +238,41 @@ void PUSART::write_command(uint8_t cmd) {
   }
 }
 
-void PUSART::write_data(uint8_t dat) {
-  xoff = (dat == '\023');
-  if (dat == '\023' || dat == '\021') return;
-  if (write(pty_fd,&dat,1) < 0) {
-    close(pty_fd);
-    pty_fd = -1;
+// The byte goes to the transmitter if it is idle, else waits in the
+// holding register, and TxRDY is low, until the transmitter is done
+void PUSART::write_data(uint8_t dat, unsigned long long now) {
+  const unsigned long t = unthrottled ? 0 : char_time(speed);
+  if (now >= tx_idle_at) {
+    tx_hold_at = now;
+    tx_idle_at = now + t;
+  } else {
+    tx_hold_at = tx_idle_at;
+    tx_idle_at += t;
+  }
+  // XOFF and XON are not sent on: the host is stopped and started by
+  // not reading the line, see ioThread()
+  if (dat == '\023' || dat == '\021') {
+    const bool off = dat == '\023';
+    if (off == xoff) return;
+    if (off) {
+      stats.xoffs++;
+      xoff_since = now;
+    } else
+      stats.xoff_cycles += now - xoff_since;
+    __atomic_store_n(&xoff, off, __ATOMIC_RELEASE);
+    if (!off && wake_fd != -1) wake();
+    return;
   }
+  // After a hang-up the line starts again at the next mode byte
+  if (wake_fd == -1 || __atomic_load_n(&hung_up, __ATOMIC_ACQUIRE)) {
+    stopIO();
+    return;
+  }
+  // xmit_ready() was low if there is no room; the byte is lost then
+  if (tx_in - __atomic_load_n(&tx_out, __ATOMIC_ACQUIRE) == TX_SIZE) return;
+  tx_buf[tx_in % TX_SIZE] = dat;
+  tx_in++;
+  if (tx_in - tx_flushed >= TX_SIZE / 2) flush();
 }
 
 uint8_t PUSART::read_command() {
@@ -122,16 +284,29 @@ uint8_t PUSART::read_command() {
   return 0x80 | sync_det?0x40:0 | tx_empty?0x04:0 | rx_rdy?0x02:0 | tx_rdy?0x01:0;
 }
 
+// Take the next byte from rx_buf, without a system call; the I/O
+// thread is only woken when it waits for room and rx_buf is down to
+// RX_LOW. A byte there while the last is not read yet would have
+// overrun it on the line; here it waits.
 bool PUSART::clock() {
-  char c;
-  if (has_rx_rdy || xoff) return false;
-  int i = read(pty_fd,&c,1);
-  if (i != -1) {
-    data = c;
-    has_rx_rdy = true;
-    return true;
+  if (xoff) return false;
+  const unsigned out = rx_out;
+  const unsigned in = __atomic_load_n(&rx_in, __ATOMIC_ACQUIRE);
+  if (out == in) return false;
+  if (has_rx_rdy) {
+    if (!unthrottled) stats.overruns++;
+    return false;
+  }
+  data = rx_buf[out % RX_SIZE];
+  has_rx_rdy = true;
+  stats.rx_bytes++;
+  __atomic_store_n(&rx_out, out + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&rx_full, __ATOMIC_SEQ_CST) &&
+      in - (out + 1) <= RX_LOW) {
+    __atomic_store_n(&rx_full, false, __ATOMIC_RELAXED);
+    wake();
   }
-  return false;
+  return true;
 }
 
 uint8_t PUSART::read_data() {
@@ -139,8 +314,14 @@ uint8_t PUSART::read_data() {
   return data;
 }
 
-char* PUSART::pty_name() {
-  if (pty_fd == -1)
-    return (char*)"<NONE>";
-  return ptsname(pty_fd);
+PUSART::LineStats PUSART::line_stats(unsigned long long now) {
+  LineStats s = stats;
+  if (xoff) s.xoff_cycles += now - xoff_since;
+  return s;
+}
+
+const char* PUSART::line_name() {
+  if (wake_fd == -1)
+    return "<NONE>";
+  return line->name();
 }
@@ -3,29 +3,84 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include "hostline.h"
 
 class PUSART {
+public:
+  // What went over the line, in received bytes and CPU cycles
+  struct LineStats {
+    unsigned long long rx_bytes;
+    unsigned long long xoffs;		// times the VT100 sent XOFF
+    unsigned long long xoff_cycles;	// time the host was held off
+    unsigned long long overruns;	// bytes that would have been lost
+  };
 private:
   bool mode_select_mode;
   bool has_xmit_ready;
   uint8_t mode;
   uint8_t command;
-  int pty_fd;
+  HostLine* line;		// the host, see set_line()
   uint8_t data;
   bool has_rx_rdy;
-  bool xoff;
+  bool xoff;			// the VT100 sent XOFF, and no XON yet
+  unsigned long long xoff_since;
+  LineStats stats;
+  // Bytes from the host, read in bulk by the I/O thread as they come
+  // and taken one at a time by clock(); the indices only grow
+  static const unsigned RX_SIZE = 4096;
+  static const unsigned RX_LOW = RX_SIZE / 2;	// read again from here
+  uint8_t rx_buf[RX_SIZE];
+  unsigned rx_in, rx_out;
+  bool rx_full;			// I/O thread waits for room in rx_buf
+  // Bytes for the host, queued by write_data() until flush(); what
+  // the host did not take then is up to the I/O thread, up to tx_flushed
+  static const unsigned TX_SIZE = 1024;
+  uint8_t tx_buf[TX_SIZE];
+  unsigned tx_in, tx_flushed, tx_out;
+  pthread_mutex_t tx_mutex;	// for tx_flushed, tx_out and the fds of line
+  bool hung_up;			// the line failed, the host is gone
+  int wake_fd;			// eventfd to wake the I/O thread
+  bool io_quit;
+  pthread_t io_thread;
+  static void* ioThreadCB(void* ctx);
+  void ioThread();
+  void wake();
+  void stopIO();
+  // Line timing: the baud rate generator, receive speed in the high
+  // nibble and transmit speed in the low one, and the bits of a
+  // character, from the mode byte, in halves for 1.5 stop bits
+  uint8_t speed;
+  unsigned half_bits;
+  bool unthrottled;
+  unsigned long long tx_hold_at;	// TxRDY high again
+  unsigned long long tx_idle_at;	// transmitter done
+  unsigned long char_time(uint8_t code);
 public:
   PUSART();
-  // High if ready to transmit a byte
-  bool xmit_ready();
+  ~PUSART();
+  // High if ready to transmit a byte at CPU cycle now, and when it is
+  bool xmit_ready(unsigned long long now);
+  unsigned long long xmit_ready_at();
   void write_command(uint8_t b);
-  void write_data(uint8_t b);
+  void write_data(uint8_t b, unsigned long long now);
+  // Have the bytes written so far sent; at every vertical retrace
+  void flush();
+  // Cycles between received characters, 0 if unthrottled: then the
+  // next is there as soon as read_data() has taken the last
+  unsigned long rx_time();
+  void write_speed(uint8_t b);
+  void set_unthrottled(bool on);
   bool clock();
   bool rx_ready();
   uint8_t read_data();
   uint8_t read_command();
-  char* pty_name();
-  void start_shell();
+  // Put the host on this line rather than $SHELL on a PTY; the PUSART
+  // owns it from here and starts it at the first mode byte
+  void set_line(HostLine* l);
+  const char* line_name();
+  LineStats line_stats(unsigned long long now);
+  void start_line();
 };
 
 #endif // PUSART_H
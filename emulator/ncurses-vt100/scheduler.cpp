@@ -0,0 +1,76 @@
+#include "scheduler.h"
+
+Scheduler::Scheduler() : count(0)
+{
+    for (int i = 0; i < MAX_EVENTS; i++) pos[i] = -1;
+}
+
+void Scheduler::schedule(int event, unsigned long long when)
+{
+    int i = pos[event];
+    if (i < 0) {
+        i = count++;
+        heap[i].event = event;
+        pos[event] = i;
+    }
+    heap[i].when = when;
+    sift_up(i);
+    sift_down(pos[event]);
+}
+
+void Scheduler::cancel(int event)
+{
+    if (pos[event] >= 0) remove(pos[event]);
+}
+
+int Scheduler::pop_due(unsigned long long now)
+{
+    if (count == 0 || heap[0].when > now) return -1;
+    int event = heap[0].event;
+    remove(0);
+    return event;
+}
+
+void Scheduler::swap(int i, int j)
+{
+    Entry e = heap[i];
+    heap[i] = heap[j];
+    heap[j] = e;
+    pos[heap[i].event] = i;
+    pos[heap[j].event] = j;
+}
+
+void Scheduler::sift_up(int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent].when <= heap[i].when) break;
+        swap(i, parent);
+        i = parent;
+    }
+}
+
+void Scheduler::sift_down(int i)
+{
+    for (;;) {
+        int least = i;
+        int l = 2*i + 1, r = 2*i + 2;
+        if (l < count && heap[l].when < heap[least].when) least = l;
+        if (r < count && heap[r].when < heap[least].when) least = r;
+        if (least == i) break;
+        swap(i, least);
+        i = least;
+    }
+}
+
+void Scheduler::remove(int i)
+{
+    pos[heap[i].event] = -1;
+    if (i != --count) {
+        int moved = heap[count].event;
+        heap[i] = heap[count];
+        pos[moved] = i;
+        sift_up(i);
+        sift_down(pos[moved]);
+    }
+}
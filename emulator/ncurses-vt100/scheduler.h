@@ -0,0 +1,36 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+// Pending device events, keyed on the absolute CPU cycle (t_ticks) at
+// which they fall due. Each event id has at most one deadline; scheduling
+// it again moves it. The entries are kept in a binary min-heap so the
+// earliest deadline is always at the top.
+class Scheduler
+{
+public:
+    enum { MAX_EVENTS = 8 };
+    Scheduler();
+    void schedule(int event, unsigned long long when);
+    void cancel(int event);
+    bool pending(int event) { return pos[event] >= 0; }
+    // Earliest deadline, or ~0 if nothing is pending
+    unsigned long long next_deadline() { return count ? heap[0].when : ~0ULL; }
+    // Remove and return an event due at or before 'now'; -1 if none
+    int pop_due(unsigned long long now);
+private:
+    struct Entry {
+        unsigned long long when;
+        int event;
+    };
+    Entry heap[MAX_EVENTS];
+    int pos[MAX_EVENTS]; // heap index of each event, -1 when not pending
+    int count;
+    void swap(int i, int j);
+    void sift_up(int i);
+    void sift_down(int i);
+    void remove(int i);
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,29 @@
+#include "simlog.h"
+#include <stdio.h>
+#include <stdarg.h>
+
+static void stderrSink(void* ctx, const char* msg)
+{
+  fputs(msg, stderr);
+}
+
+static LogSink sink = stderrSink;
+static void* sink_ctx;
+
+// Set before the machines run; a NULL sink drops the messages
+void setLogSink(LogSink s, void* ctx)
+{
+  sink = s;
+  sink_ctx = ctx;
+}
+
+void simLog(const char* fmt, ...)
+{
+  char buf[256];
+  va_list ap;
+  if (sink == NULL) return;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  sink(sink_ctx, buf);
+}
@@ -0,0 +1,12 @@
+#ifndef SIMLOG_H
+#define SIMLOG_H
+
+// Messages of the simulator and its devices go to a sink: stderr
+// unless the front end sets another, like the message window of the
+// curses screen or the --log file of vt100headless.
+typedef void (*LogSink)(void* ctx, const char* msg);
+
+void setLogSink(LogSink sink, void* ctx);
+void simLog(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // SIMLOG_H
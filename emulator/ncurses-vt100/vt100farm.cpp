@@ -0,0 +1,200 @@
+// vt100farm: run many VT100s in one process, for load testing the
+// full screen programs behind them. Every instance boots the same ROM
+// and gets its own PTY with $SHELL (or the --exec program) on it, as
+// in vt100sim. The instances are dealt out to worker threads, each of
+// which runs its share a slice at a time; see 8080/machine.h. The
+// instances share one ROM image, so a thread going from one to the next
+// keeps the ROM caches of the goto, jit and aot cores (see
+// mem_rom_loaded()), and they pay off here as in vt100sim: the jit and
+// aot cores run the farm fastest, then goto, then table.
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+#include "vt100sim.h"
+#include "optionparser.h"
+#include "8080/simglb.h"
+
+int utf8_term = 0;
+
+static const int CPUHZ = 2764800;
+static const unsigned long long QUANTUM = CPUHZ / 100; // cycles per turn
+
+option::ArgStatus checkNum(const option::Option& opt, bool msg) {
+  char* tail;
+  if (opt.arg == NULL) return option::ARG_ILLEGAL;
+  strtoul(opt.arg,&tail,10);
+  if (*tail != '\0' || tail == opt.arg) return option::ARG_ILLEGAL;
+  else return option::ARG_OK;
+}
+
+option::ArgStatus checkArg(const option::Option& opt, bool msg) {
+  return opt.arg && *opt.arg ? option::ARG_OK : option::ARG_ILLEGAL;
+}
+
+enum OptionIndex { UNKNOWN, HELP, INSTANCES, THREADS, SECONDS, REALTIME, EXEC, NOAVO, NOSKIP, UNTHROTTLED };
+const option::Descriptor usage[] = {
+  { UNKNOWN, 0, "", "", option::Arg::None, "Usage: vt100farm [options] ROM.bin" },
+  { HELP, 0, "h", "help", option::Arg::None, "--help, -h\tPrint usage and exit" },
+  { INSTANCES, 0, "n", "instances", checkNum, "--instances, -n\tNumber of VT100s (4)"},
+  { THREADS, 0, "t", "threads", checkNum, "--threads, -t\tNumber of worker threads (one per CPU)"},
+  { SECONDS, 0, "s", "seconds", checkNum, "--seconds, -s\tRun for this long, then report (10)"},
+  { REALTIME, 0, "r", "realtime", option::Arg::None, "--realtime, -r\tRun each VT100 at its real speed rather than flat out"},
+  { EXEC, 0, "e", "exec", checkArg, "--exec, -e\tProgram to run on each PTY instead of $SHELL"},
+  { NOAVO, 0, "N", "noavo", option::Arg::None, "--noavo, -N\tDisable AVO flag."},
+  { NOSKIP, 0, "S", "noskip", option::Arg::None, "--noskip, -S\tInterpret idle loops instead of skipping them."},
+  { UNTHROTTLED, 0, "U", "unthrottled", option::Arg::None, "--unthrottled, -U  \tGive the firmware each byte from the host as soon as it has taken the last, not at the line speed."},
+  {0,0,0,0,0,0}
+};
+
+// One VT100 of the farm, with what it did in the run
+struct Instance {
+  Vt100Sim* sim;
+  unsigned long long cycles;
+  long instructions;
+  unsigned long long skipped;
+};
+
+struct Worker {
+  pthread_t thread;
+  std::vector<Instance*> share;
+};
+
+static bool realtime;
+static struct timespec start, stop;
+
+static double since(const struct timespec& from, const struct timespec& to)
+{
+  return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) / 1e9;
+}
+
+static bool before(const struct timespec& a, const struct timespec& b)
+{
+  return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+// When a VT100 that has run the given cycles is due again in real time
+static struct timespec due(unsigned long long cycles)
+{
+  struct timespec t = start;
+  long long nsec = cycles * 1000000000ULL / CPUHZ;
+  t.tv_sec += nsec / 1000000000;
+  t.tv_nsec += nsec % 1000000000;
+  if (t.tv_nsec >= 1000000000) {
+    t.tv_sec++;
+    t.tv_nsec -= 1000000000;
+  }
+  return t;
+}
+
+// Give every instance of the share a quantum in turn until the time is
+// up. In real time an instance is only run once the wall clock has
+// caught up with it, and the worker sleeps while none is due.
+static void* work(void* arg)
+{
+  Worker* w = (Worker*)arg;
+  struct timespec now;
+  do {
+    struct timespec next = stop;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (size_t i = 0; i < w->share.size(); i++) {
+      Instance* in = w->share[i];
+      if (realtime) {
+	struct timespec t = due(in->cycles);
+	if (before(now, t)) {
+	  if (before(t, next)) next = t;
+	  continue;
+	}
+      }
+      in->sim->enter();
+      const unsigned long long end = t_ticks + QUANTUM;
+      const long r = R;
+      const unsigned long long from = t_ticks;
+      while (t_ticks < end && cpu_error == NONE)
+	in->sim->runSlice();
+      in->cycles += t_ticks - from;
+      in->instructions += R - r;
+      in->skipped = in->sim->idleSkipped();
+      in->sim->leave();
+      next = now;
+    }
+    if (before(now, next))
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+	;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+  } while (before(now, stop));
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  argc-=(argc>0); argv+=(argc>0); // skip program name argv[0] if present
+  option::Stats  stats(usage, argc, argv);
+  option::Option options[stats.options_max], buffer[stats.buffer_max];
+  option::Parser parse(usage, argc, argv, options, buffer);
+  if (parse.error()) return 1;
+  if (options[HELP] || argc == 0) {
+    option::printUsage(std::cout, usage);
+    return 0;
+  }
+  if (parse.nonOptionsCount() < 1) {
+    std::cout << "No ROM specified"; return 1;
+  }
+  int n = options[INSTANCES] ? atoi(options[INSTANCES].arg) : 4;
+  int threads = options[THREADS] ? atoi(options[THREADS].arg) : sysconf(_SC_NPROCESSORS_ONLN);
+  int seconds = options[SECONDS] ? atoi(options[SECONDS].arg) : 10;
+  realtime = options[REALTIME];
+  if (options[EXEC]) setenv("SHELL", options[EXEC].arg, 1);
+  if (n < 1) n = 1;
+  if (threads < 1) threads = 1;
+  if (threads > n) threads = n;
+
+  // Build the VT100s here, then hand them to the workers
+  std::vector<Instance> farm(n);
+  std::vector<Worker> workers(threads);
+  for (int i = 0; i < n; i++) {
+    Instance& in = farm[i];
+    in.sim = new Vt100Sim(parse.nonOptions()[0],true,!options[NOAVO],false);
+    in.sim->init();
+    in.sim->setIdleSkip(!options[NOSKIP]);
+    in.sim->uart.set_unthrottled(options[UNTHROTTLED]);
+    in.sim->leave();
+    in.cycles = in.skipped = 0;
+    in.instructions = 0;
+    workers[i % threads].share.push_back(&in);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  stop = start;
+  stop.tv_sec += seconds;
+  for (int i = 0; i < threads; i++)
+    pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+  for (int i = 0; i < threads; i++)
+    pthread_join(workers[i].thread, NULL);
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  const double secs = since(start, end);
+
+  long total = 0;
+  for (int i = 0; i < n; i++) {
+    Instance& in = farm[i];
+    in.sim->enter();
+    const PUSART::LineStats ls = in.sim->uart.line_stats(t_ticks);
+    fprintf(stderr, "vt100 %3d on %s: %llu cycles, %.2f MIPS, %.1fx real time, %.1f%% skipped\n",
+	    i, in.sim->uart.line_name(), in.cycles, in.instructions / secs / 1e6,
+	    in.cycles / (double)CPUHZ / secs,
+	    in.cycles ? in.skipped * 100.0 / in.cycles : 0.0);
+    fprintf(stderr, "          line: %llu bytes in, %llu XOFFs, %.1f%% held off, %llu overruns\n",
+	    ls.rx_bytes, ls.xoffs, in.cycles ? ls.xoff_cycles * 100.0 / in.cycles : 0.0,
+	    ls.overruns);
+    total += in.instructions;
+    delete in.sim;
+  }
+  fprintf(stderr, "%d VT100s on %d threads for %.3f s: %ld instructions, %.2f MIPS\n",
+	  n, threads, secs, total, total / secs / 1e6);
+  return 0;
+}
@@ -1,15 +1,21 @@
 
 #include "vt100sim.h"
+#include "simlog.h"
 #include "8080/sim.h"
 #include "8080/simglb.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <ncurses.h>
 #include <time.h>
 #include <signal.h>
+#include <errno.h>
 #include <map>
 #include <ctype.h>
+#include <algorithm>
+#include <string>
 
 extern "C" {
 extern void int_on(void), int_off(void);
@@ -22,6 +28,8 @@ extern int getkey(void);
 extern void int_on(void), int_off(void);
 extern int load_file(char *);
 
+#include "8080/memory.h"
+#include "8080/machine.h"
 }
 
 Vt100Sim* sim;
@@ -33,22 +41,73 @@ WINDOW* msgWin;
 WINDOW* statusBar;
 WINDOW* bpWin;
 
-Vt100Sim::Vt100Sim(const char* romPath, bool running, bool avo_on) :
+static void makeGlyphs();
+
+// The messages wait for the screen thread to show them, whichever
+// thread logs them
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::string log_pending;
+
+static void msgWinSink(void* ctx, const char* msg)
+{
+  pthread_mutex_lock(&log_mutex);
+  log_pending += msg;
+  pthread_mutex_unlock(&log_mutex);
+}
+
+static void flushLog()
+{
+  pthread_mutex_lock(&log_mutex);
+  if (!log_pending.empty()) {
+    wprintw(msgWin,"%s",log_pending.c_str());
+    wrefresh(msgWin);
+    log_pending.clear();
+  }
+  pthread_mutex_unlock(&log_mutex);
+}
+
+Vt100Sim::Vt100Sim(const char* romPath, bool running, bool avo_on, bool screen) :
 	running(running), inputMode(false),
 	dc12(true), controlMode(!running),
-	enable_avo(avo_on)
+	enable_avo(avo_on), screen(screen)
 {
+  // The machine is run by the thread creating it, until leave()
+  struct cpu_io io = { ioInCB, ioOutCB, memHookCB, this };
+  if ((mach = machine_new(&io)) == NULL) {
+    perror("vt100sim");
+    exit(1);
+  }
+  machine_enter(mach);
   this->romPath = romPath;
   base_attr = 0;
   screen_rev = 0;
   blink_ff = 0;
+  shown_rows = 0;
+  shown_cols = -1;	// nothing drawn yet
+  vscan_tick = 0;
+  frame_back = 0;
+  frame_mid = 1;
+  frame_front = 2;
+  stops = 0;
+  pthread_mutex_init(&hold_mutex, NULL);
+  pthread_cond_init(&hold_cond, NULL);
+  hold_req = 0;
+  steps = 0;
+  typed_in = typed_out = 0;
+  synced_ticks = 0;
+  watch_hit = false;
+  idle.valid = false;
+  idle_skip = true;
+  idle_skipped = 0;
 
   //breakpoints.insert(8);
   //breakpoints.insert(0xb);
+  if (!screen) return;	// run() is not for it, the windows stay NULL
   initscr();
   int my,mx;
   getmaxyx(stdscr,my,mx);
   start_color();
+  makeGlyphs();
   raw();
   nonl();
   noecho();
@@ -91,46 +150,55 @@ Vt100Sim::Vt100Sim(const char* romPath, bool running, bool avo_on) :
   wattron(regWin,COLOR_PAIR(1));
   wattron(memWin,COLOR_PAIR(2));
   refresh();
+  setLogSink(msgWinSink,NULL);
 }
 
 Vt100Sim::~Vt100Sim() {
-  curs_set(1);
-  endwin();
+  if (screen) {
+    setLogSink(NULL,NULL);
+    curs_set(1);
+    endwin();
+  }
+  machine_leave(mach);
+  machine_free(mach);
+  pthread_mutex_destroy(&hold_mutex);
+  pthread_cond_destroy(&hold_cond);
 }
 
-class Signal {
+void Vt100Sim::enter() { machine_enter(mach); }
+void Vt100Sim::leave() { machine_leave(mach); }
+
+// A free running square wave derived from the CPU clock. It starts low
+// at cycle 0 and rises half a period later, so its state at any cycle
+// can be computed rather than toggled along with the CPU.
+class Clock {
 private:
-    bool value;
-    bool has_change;
-    uint16_t period_half;
-    uint16_t ticks;
+    uint32_t period_half;
 public:
-    Signal(uint16_t period);
-    bool add_ticks(uint16_t delta);
-    bool get_value() { return value; }
-};
-
-Signal::Signal(uint16_t period) : value(false),has_change(false),period_half(period/2),ticks(0) {
-}
-
-bool Signal::add_ticks(uint16_t delta) {
-    ticks += delta;
-    if (ticks >= period_half) {
-        ticks -= period_half;
-        value = !value;
-        return true;
+    Clock(uint32_t period) : period_half(period/2) {}
+    bool value_at(unsigned long long t) { return (t / period_half) & 1; }
+    // Number of rising edges in the cycles [0, t]
+    unsigned long long rising_upto(unsigned long long t) {
+      return (t + period_half) / (2 * period_half);
     }
-    return false;
-}
+    // Cycle of the n'th rising edge after t
+    unsigned long long next_rising(unsigned long long t, uint32_t n = 1) {
+      return (rising_upto(t) + n - 1) * 2 * period_half + period_half;
+    }
+    // First cycle after t at which value_at() differs
+    unsigned long long next_change(unsigned long long t) {
+      return (t / period_half + 1) * period_half;
+    }
+};
 
 // In terms of processor cycles:
 // LBA4 : period of 22 cycles
 // LBA7 : period of 182 cycles
 // Vertical interrupt: period of 46084 cycles
-Signal lba4(22);
-Signal lba7(182);
-Signal vertical(46084);
-Signal uartclk(5000); // uart clock is super arbitrary
+Clock lba4(22);
+Clock lba7(182);
+Clock vertical(46084);
+const uint32_t UART_PERIOD = 2500; // idle line poll when unthrottled
 
 void Vt100Sim::init() {
     i_flag = 1;
@@ -138,9 +206,9 @@ void Vt100Sim::init() {
     m_flag = 0;
     tmax = f_flag*10000;
     cpu = I8080;
-    wprintw(msgWin,"\nRelease %s, %s\n", RELEASE, COPYR);
+    simLog("\nRelease %s, %s\n", RELEASE, COPYR);
 #ifdef	USR_COM
-    wprintw(msgWin,"\n%s Release %s, %s\n", USR_COM, USR_REL, USR_CPR);
+    simLog("\n%s Release %s, %s\n", USR_COM, USR_REL, USR_CPR);
 #endif
 
     //printf("Prep ram\n");
@@ -150,46 +218,54 @@ void Vt100Sim::init() {
     if (cpu == I8080)	/* the unused flag bits are documented for */
         F = 2;		/* the 8080, so start with bit 1 set */
     memset((char *)	ram, m_flag, 65536);
-    memset((char *)	touched, m_flag, 65536);
+#ifdef WANT_DIRTY
+    memset((char *)	dirty, 0, DIRTY_SIZE);
+#endif
     // load binary
-    wprintw(msgWin,"Loading rom %s...\n",romPath);
-    wrefresh(msgWin);
+    simLog("Loading rom %s...\n",romPath);
     FILE* romFile = fopen(romPath,"rb");
     if (!romFile) {
-      wprintw(msgWin,"Failed to read rom file\n");
-      wrefresh(msgWin);
+      simLog("Failed to read rom file\n");
         return;
     }
     uint32_t count = fread((char*)ram,1,2048*4,romFile);
     //printf("Read ROM file; %u bytes\n",count);
     fclose(romFile);
+    // the ROM is read only from here on; see 8080/memory.h
+    memset(mem_page, MEM_ROM, ROM_TOP >> 8);
+    mem_rom_loaded();
     int_on();
     // add local io hooks
     
     i_flag = 0;
 
-    // We are always running the CPU in single-step mode so we can do the clock toggles when necessary.
+    // The CPU is run in single steps or in slices ending at the next
+    // device event; see runSlice().
     cpu_state = SINGLE_STEP;
-
-    wprintw(msgWin,"Function Key map:\n");
-    wprintw(msgWin,"F1..F4 -> PF1..PF4\n");
-    wprintw(msgWin,"F6 -> Break\n");
-    wprintw(msgWin,"F7 -> S-Break\n");
-    wprintw(msgWin,"F8 -> Escape\n");
-    wprintw(msgWin,"F9 -> Setup\n");
-    wprintw(msgWin,"F10 -> Cmd Mode\n");
-    wprintw(msgWin,"F11 -> Keycodes\n");
-    wrefresh(msgWin);
+    schedule(EV_UART, UART_PERIOD);
+    schedule(EV_VERTICAL, vertical.next_rising(0));
+
+    if (!screen) return;
+    simLog("Function Key map:\n");
+    simLog("F1..F4 -> PF1..PF4\n");
+    simLog("F6 -> Break\n");
+    simLog("F7 -> S-Break\n");
+    simLog("F8 -> Escape\n");
+    simLog("F9 -> Setup\n");
+    simLog("F10 -> Cmd Mode\n");
+    simLog("F11 -> Keycodes\n");
 }
 
 BYTE Vt100Sim::ioIn(BYTE addr) {
+  if (idle_skip) idleCheck(addr);
   if (addr == 0x00) {
     uint8_t r = uart.read_data();
-    //wprintw(msgWin,"PUSART RD DAT: %x\n", r);
+    if (!uart.rx_time()) schedule(EV_UART, t_ticks);
+    //simLog("PUSART RD DAT: %x\n", r);
     return r;
   } else if (addr == 0x01) {
     uint8_t r = uart.read_command();
-    //wprintw(msgWin,"PUSART RD CMD: %x\n", r);
+    //simLog("PUSART RD CMD: %x\n", r);
     return r;
   } else if (addr == 0x42) {
         // Read buffer flag
@@ -203,13 +279,14 @@ BYTE Vt100Sim::ioIn(BYTE addr) {
 	if (enable_avo)
 	    flags = 0x04;
 
-        if (lba7.get_value()) {
+        syncDevices();
+        if (lba7.value_at(t_ticks)) {
             flags |= 0x40;
         }
         if (nvr.data()) {
             flags |= 0x20;
         }
-	if (uart.xmit_ready()) {
+	if (uart.xmit_ready(t_ticks)) {
 	  flags |= 0x01;
 	}
         if (t_ticks % (46084*2) < 46084) flags |= 0x10;
@@ -219,6 +296,7 @@ BYTE Vt100Sim::ioIn(BYTE addr) {
         //printf(" IN PORT %02x -- %02x\n",addr,flags);fflush(stdout);
         return flags;
     } else if (addr == 0x82) {
+      syncDevices();
       return kbd.get_latch();
     } else {
       //printf(" IN PORT %02x at %04lx\n",addr,PC-ram);fflush(stdout);
@@ -227,21 +305,26 @@ BYTE Vt100Sim::ioIn(BYTE addr) {
 }
 
 void Vt100Sim::ioOut(BYTE addr, BYTE data) {
+    idle.valid = false;
     switch(addr) {
     case 0x00:
-      //wprintw(msgWin,"PUSART DAT: %x\n", data);wrefresh(msgWin);
-      uart.write_data(data);
+      //simLog("PUSART DAT: %x\n", data);
+      uart.write_data(data, t_ticks);
       break;
     case 0x01:
-      //wprintw(msgWin,"PUSART CMD: %x\n", data);wrefresh(msgWin);
+      //simLog("PUSART CMD: %x\n", data);
       uart.write_command(data);
       break;
     case 0x02:
+      uart.write_speed(data);
       break;
     case 0x82:
+        syncDevices();
         kbd.set_status(data);
+        scheduleKbd();
         break;
     case 0x62:
+        syncDevices();
         nvr.set_latch(data);
 	break;
     case 0x42:
@@ -249,8 +332,7 @@ void Vt100Sim::ioOut(BYTE addr, BYTE data) {
       break;
 
     case 0xa2:
-      //wprintw(msgWin,"DC12 %02x\n",data);
-      //wrefresh(msgWin);
+      //simLog("DC12 %02x\n",data);
       dc12 = true;
       switch (data & 0xF) {
       case 0: case 1: case 2: case 3:
@@ -274,13 +356,11 @@ void Vt100Sim::ioOut(BYTE addr, BYTE data) {
       break;
 
     case 0xc2:
-      //wprintw(msgWin,"DC11 %02x\n",data);
-      //wrefresh(msgWin);
+      //simLog("DC11 %02x\n",data);
       break;
 
     default:
-	wprintw(msgWin,"OUT PORT %02x <- %02x\n",addr,data);
-	wrefresh(msgWin);
+	simLog("OUT PORT %02x <- %02x\n",addr,data);
 	break;
     }
 }
@@ -430,65 +510,29 @@ bool hexParse(char* buf, int n, uint16_t& d) {
   return true;
 }
 
+// The CPU runs on a thread of its own, cpuThread(), and this one only
+// draws the frames it publishes and reads the keyboard. The commands
+// of control mode take the machine over with hold() while they work
+// on it; the keys typed go to the CPU thread through typed[].
 void Vt100Sim::run() {
-  const int CPUHZ = 2764800;
-  int steps = 0;
-  needsUpdate = true;
-  gettimeofday(&last_sync, 0);
-  has_breakpoints = (breakpoints.size() != 0);
+  const int FRAME_MS = 20;	// most often the screen is drawn
+  pthread_t cpu;
+  unsigned long stops_seen = stops;
+  publish();
+  takeFrame();
+  leave();
+  cpu_held = quit = false;
+  pthread_create(&cpu, NULL, cpuThreadCB, this);
+  timeout(FRAME_MS);
+  update();
   while(1) {
-    if (running) {
-      step();
-      if (steps > 0) {
-	if (--steps == 0) { running = false; }
-      }
-      uint16_t pc = (uint16_t)(PC-ram);
-      //wprintw(msgWin,"BP %d PC %d\n",breakpoints.size(),pc);wrefresh(msgWin);
-      if (has_breakpoints && breakpoints.find(pc) != breakpoints.end()) {
-	wprintw(msgWin,"Breakpoint trace for %04x:\n",pc);
-	for (int i = 10; i > 1; i--) {
-	  uint16_t laddr = his[(HISIZE+h_next-i)%HISIZE].h_adr;
-	  wprintw(msgWin,"  PC %04x\n",laddr);
-	}
-	wrefresh(msgWin);
+    int ch = getch();
+    if (takeFrame()) {
+      if (frames[frame_front].stops != stops_seen) {
+	stops_seen = frames[frame_front].stops;
 	controlMode = true;
-	running = false;
       }
-      if (rt_ticks > CPUHZ/100) {
-        struct timeval now;
-	gettimeofday(&now, 0);
-	long long clock_usec =
-	    (now.tv_sec-last_sync.tv_sec) * 1000000 +
-	    (now.tv_usec-last_sync.tv_usec) ;
-	long long cpu_usec = rt_ticks * 1000000 / CPUHZ;
-
-	if (cpu_usec > clock_usec+10000) {
-	  usleep(cpu_usec - clock_usec);
-	  last_sync = now;
-	  rt_ticks -= clock_usec * CPUHZ / 1000000;
-	} else {
-	  /* EMU is too slow ? */
-	}
-      }
-    } else {
-      usleep(50000);
-      gettimeofday(&last_sync, 0);
-      rt_ticks = 0;
-    }
-    int ch = ERR;
-    if (vscan_tick) {
-      vscan_tick--;
-      refresh_clock++;
-      if (needsUpdate && refresh_clock>3) { update(); refresh_clock=0; }
-
-      if (!kbd.busy_scanning())
-	  ch = getch();
-
-      has_breakpoints = (breakpoints.size() != 0);
-    } else if (!running) {
-      if (needsUpdate) update();
-      ch = getch();
-      has_breakpoints = (breakpoints.size() != 0);
+      update();
     }
     if (ch != ERR) {
       if (ch == KEY_F(10)) { // Control Mode key
@@ -496,32 +540,87 @@ void Vt100Sim::run() {
 	dispStatus();
       } else if (controlMode) {
 	if (ch == 'q' || ch == 4 || ch == 3) {
-	  return;
+	  break;
 	}
 	else if (ch == ' ') {
+	  hold();
 	  running = !running;
+	  release();
 	}
 	else if (ch == 'n') {
+	  hold();
 	  running = true; steps = 1;
+	  release();
 	}
 	else if (ch == 'm') {
-	  snapMemory(); dispMemory();
+	  hold();
+	  snapMemory();
+	  release();
 	}
 	else if (ch == 'b') {
-	  char bpbuf[10];
-	  getString("Addr. of breakpoint: ",bpbuf,4);
+	  char bpbuf[32];
+	  getString("Breakpoint (addr [reg=val] [#hits]): ",bpbuf,31);
 	  werase(statusBar);
 	  dispStatus();
-	  uint16_t bp;
-	  if (hexParse(bpbuf,4,bp)) {
-	    addBP(bp);
-	    dispBPs();
+	  hold();
+	  bool ok = addBP(bpbuf);
+	  release();
+	  if (ok) {
 	    mvwprintw(statusBar,0,0,"Breakpoint addded at %s\n",bpbuf); 
 	  } else {
 	    mvwprintw(statusBar,0,0,"Bad breakpoint %s\n",bpbuf); 
 	  }
-	  // set up breakpoints
-	  gettimeofday(&last_sync, 0);	// CPU was frozen
+	}
+	else if (ch == 'w') {
+	  char bpbuf[10], from[5], to[5];
+	  getString("Addr. to watch (addr[-addr]): ",bpbuf,9);
+	  werase(statusBar);
+	  dispStatus();
+	  uint16_t bp, end;
+	  int n = sscanf(bpbuf,"%4[0-9a-fA-F]-%4[0-9a-fA-F]",from,to);
+	  if (n >= 1 && hexParse(from,4,bp) && (n == 1 || hexParse(to,4,end))) {
+	    if (n == 1) end = bp;
+	    hold();
+	    for (unsigned a = bp; a <= end; a++) addWatch(a);
+	    release();
+	    mvwprintw(statusBar,0,0,"Watchpoint added at %s\n",bpbuf); 
+	  } else {
+	    mvwprintw(statusBar,0,0,"Bad watchpoint %s\n",bpbuf); 
+	  }
+	}
+	else if (ch == 'h') {
+	  char buf[12], prompt[48];
+	  snprintf(prompt,sizeof(prompt),"History entries (0: off, none: %d): ",HISIZE);
+	  getString(prompt,buf,11);
+	  werase(statusBar);
+	  dispStatus();
+	  char* tail;
+	  unsigned long n = buf[0] ? strtoul(buf,&tail,10) : HISIZE;
+	  bool ok = false;
+	  if (!buf[0] || (tail != buf && *tail == '\0')) {
+	    hold();
+	    ok = setHistory(n);
+	    release();
+	  }
+	  if (ok) {
+	    mvwprintw(statusBar,0,0,"History %s\n",n ? buf : "off");
+	  } else {
+	    mvwprintw(statusBar,0,0,"Bad history size %s\n",buf);
+	  }
+	}
+	else if (ch == 'H') {
+	  char buf[64];
+	  getString("Save history to: ",buf,63);
+	  werase(statusBar);
+	  dispStatus();
+	  hold();
+	  bool ok = saveHistory(buf);
+	  release();
+	  if (ok) {
+	    mvwprintw(statusBar,0,0,"History saved to %s\n",buf);
+	  } else {
+	    mvwprintw(statusBar,0,0,"Cannot save history to %s\n",buf);
+	  }
 	}
 	else if (ch == 'd') {
 	  char bpbuf[10];
@@ -530,18 +629,19 @@ void Vt100Sim::run() {
 	  dispStatus();
 	  uint16_t bp;
 	  if (hexParse(bpbuf,4,bp)) {
-	    if (breakpoints.count(bp) == 0) {
+	    hold();
+	    bool found = breakpoints.count(bp) || watchpoints.count(bp);
+	    clearBP(bp);
+	    clearWatch(bp);
+	    release();
+	    if (!found) {
 	      mvwprintw(statusBar,0,0,"No breakpoint %s\n",bpbuf); 
 	    } else {
-	      clearBP(bp);
-	      dispBPs();
 	      mvwprintw(statusBar,0,0,"Breakpoint removed at %s\n",bpbuf); 
 	    }
 	  } else {
 	    mvwprintw(statusBar,0,0,"Bad breakpoint %s\n",bpbuf); 
 	  }
-	  // set up breakpoints
-	  gettimeofday(&last_sync, 0);	// CPU was frozen
 	}
       }
       else {
@@ -550,39 +650,192 @@ void Vt100Sim::run() {
 	    if (ch == KEY_F(11)) {
 		kstat = 1; ksum = 0;
 	    } else if (ch == '\n' || ch == '\r') {
-		//wprintw(msgWin,"KC=%02x\n", ksum); wrefresh(msgWin);
-		if (ksum & 0x80) {
-		  keypress(0x7d);	// Shift Key
-		  ksum &= 0x7f;
-		}
-		if (ksum)
-		    keypress(ksum);
+		//simLog("KC=%02x\n", ksum);
+		type(KEYCODE | (ksum & 0xff));
 		ksum = kstat = 0;
 	    } else if (ch >='0' && ch <='9') {
 		ksum = ksum * 10 + ch - '0';
 	    } else
 		kstat = 0;
 	} else {
-	    uint8_t kc = code[ch];
-	    if (kc == 0 && ch >= 0 && ch < 32) {
-		kc = code[ch+'`'];
-		if (kc) {
-	          //wprintw(msgWin,"KC=7c (Control)\n");
-		  keypress(0x7c);	// Control Key
-		}
-	    }
-	    if (kc & 0x80) {
-	      //wprintw(msgWin,"KC=7d (Shift)\n");
-	      keypress(0x7d);	// Shift Key
-	      kc &= 0x7f;
-	    }
-	    //wprintw(msgWin,"KC=%02x < %02x\n", kc, ch); wrefresh(msgWin);
-	    if (kc)
-	      keypress(kc);
+	    type(ch);
 	}
       }
     }
   }
+  hold();
+  quit = true;
+  release();
+  pthread_join(cpu, NULL);
+  enter();
+}
+
+void* Vt100Sim::cpuThreadCB(void* ctx)
+{
+  ((Vt100Sim*)ctx)->cpuThread();
+  return NULL;
+}
+
+// Run the machine in real time, a slice at a time, until run() quits.
+// Between slices it is handed to the screen thread when that asks
+// for it, and it rests while stopped.
+void Vt100Sim::cpuThread() {
+  const int CPUHZ = 2764800;
+  enter();
+  clock_gettime(CLOCK_MONOTONIC, &last_sync);
+  rt_ticks = 0;
+  while(1) {
+    if (__atomic_load_n(&hold_req, __ATOMIC_ACQUIRE) || !running) {
+      cpuPause();
+      if (quit) break;
+      clock_gettime(CLOCK_MONOTONIC, &last_sync);	// CPU was frozen
+      rt_ticks = 0;
+      continue;
+    }
+    // Slices end at breakpoints and watchpoints by themselves
+    if (steps > 0)
+      step();
+    else
+      runSlice();
+    if (steps > 0) {
+      if (--steps == 0) { running = false; }
+    }
+    uint16_t pc = (uint16_t)(PC-ram);
+    //simLog("BP %d PC %d\n",breakpoints.size(),pc);
+    if (((brk_map[pc] & BRK_EXEC) && hitBP(breakpoints[pc])) || watch_hit) {
+      watch_hit = false;
+      simLog("Breakpoint trace for %04x:\n",pc);
+      for (unsigned long i = std::min(h_next, 10UL); his && i > 1; i--) {
+	struct history* hp = &his[(h_next-i) & h_mask];
+	simLog("  PC %04x F %02x\n",hp->h_adr,hp->h_af & 0xff);
+      }
+      stops++;
+      running = false;
+    }
+    if (vscan_tick) {
+      vscan_tick = 0;
+      // One key a frame, once the keyboard has sent the last one
+      if (!kbd.busy_scanning() &&
+	  typed_out != __atomic_load_n(&typed_in, __ATOMIC_ACQUIRE)) {
+	pressKey(typed[typed_out % 64]);
+	__atomic_store_n(&typed_out, typed_out + 1, __ATOMIC_RELEASE);
+      }
+      publish();
+    } else if (!running)
+      publish();
+    // A halted CPU has jumped to its next interrupt, sleep until
+    // that is due rather than until the next 10ms are up.
+    if (rt_ticks > CPUHZ/100 || cpu_halt) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      long long clock_nsec =
+	  (now.tv_sec-last_sync.tv_sec) * 1000000000LL +
+	  (now.tv_nsec-last_sync.tv_nsec) ;
+      long long cpu_nsec = rt_ticks * 1000000000LL / CPUHZ;
+
+      if (cpu_nsec > clock_nsec + (cpu_halt ? 0 : 10000000)) {
+	struct timespec until = last_sync;
+	until.tv_sec += cpu_nsec / 1000000000;
+	until.tv_nsec += cpu_nsec % 1000000000;
+	if (until.tv_nsec >= 1000000000) {
+	  until.tv_sec++;
+	  until.tv_nsec -= 1000000000;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0) == EINTR)
+	  ;
+	last_sync = until;
+	rt_ticks -= cpu_nsec * CPUHZ / 1000000000;
+      } else {
+	/* EMU is too slow ? */
+      }
+    }
+  }
+  leave();
+}
+
+// Give up the machine while the screen holds it or it is stopped
+void Vt100Sim::cpuPause() {
+  leave();
+  pthread_mutex_lock(&hold_mutex);
+  cpu_held = true;
+  pthread_cond_broadcast(&hold_cond);
+  while (hold_req || (!running && !quit))
+    pthread_cond_wait(&hold_cond, &hold_mutex);
+  cpu_held = false;
+  pthread_mutex_unlock(&hold_mutex);
+  enter();
+}
+
+// Take the machine from the CPU thread, which waits at the end of its
+// slice until release(). In between the machine is this thread's.
+void Vt100Sim::hold() {
+  pthread_mutex_lock(&hold_mutex);
+  __atomic_store_n(&hold_req, 1, __ATOMIC_RELEASE);
+  while (!cpu_held)
+    pthread_cond_wait(&hold_cond, &hold_mutex);
+  pthread_mutex_unlock(&hold_mutex);
+  enter();
+}
+
+void Vt100Sim::release() {
+  publish();
+  leave();
+  pthread_mutex_lock(&hold_mutex);
+  __atomic_store_n(&hold_req, 0, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&hold_cond);
+  pthread_mutex_unlock(&hold_mutex);
+}
+
+// Queue a key for the CPU thread, dropped if 64 are waiting
+void Vt100Sim::type(int ch) {
+  if (typed_in - __atomic_load_n(&typed_out, __ATOMIC_ACQUIRE) == 64) return;
+  typed[typed_in % 64] = ch;
+  __atomic_store_n(&typed_in, typed_in + 1, __ATOMIC_RELEASE);
+}
+
+// Fill the back frame from the machine and pass it on
+void Vt100Sim::publish() {
+  Frame& f = frames[frame_back];
+  f.rows = readScreen(f.lines, ScreenLine::ROWS);
+  f.scroll_latch = scroll_latch;
+  f.screen_rev = screen_rev;
+  f.bright = bright;
+  f.a = A; f.b = B; f.c = C; f.d = D; f.e = E; f.h = H; f.l = L;
+  f.pc = PC - ram;
+  f.sp = STACK - ram;
+  memcpy(f.mem, ram + 0x2000, FRAME_MEM);
+#ifdef WANT_DIRTY
+  memcpy(f.dirty, dirty + 0x2000/8, FRAME_MEM/8);
+#endif
+  f.kbd_status = kbd.get_status();
+  f.running = running;
+  f.stops = stops;
+  f.nbps = 0;
+  for (std::map<uint16_t, Breakpoint>::iterator i = breakpoints.begin();
+       i != breakpoints.end() && f.nbps < 16; i++) {
+    f.bps[f.nbps].kind = i->second.reg >= 0 ? '?' : ' ';
+    f.bps[f.nbps].addr = i->first;
+    f.bps[f.nbps++].hits = i->second.hits;
+  }
+  for (std::map<uint16_t, Breakpoint>::iterator i = watchpoints.begin();
+       i != watchpoints.end() && f.nbps < 16; i++) {
+    f.bps[f.nbps].kind = 'W';
+    f.bps[f.nbps].addr = i->first;
+    f.bps[f.nbps++].hits = i->second.hits;
+  }
+  snprintf(f.pty, sizeof(f.pty), "%s", uart.line_name());
+  frame_back = __atomic_exchange_n(&frame_mid, frame_back | FRAME_FRESH,
+				   __ATOMIC_ACQ_REL) & ~FRAME_FRESH;
+}
+
+// Make the freshest published frame the one drawn; false if it was
+// already
+bool Vt100Sim::takeFrame() {
+  if (!(__atomic_load_n(&frame_mid, __ATOMIC_ACQUIRE) & FRAME_FRESH))
+    return false;
+  frame_front = __atomic_exchange_n(&frame_mid, frame_front,
+				    __ATOMIC_ACQ_REL) & ~FRAME_FRESH;
+  return true;
 }
 
 void Vt100Sim::getString(const char* prompt, char* buf, uint8_t sz) {
@@ -599,41 +852,212 @@ void Vt100Sim::getString(const char* prompt, char* buf, uint8_t sz) {
 
 void Vt100Sim::step()
 {
-  const uint32_t start = t_ticks;
+  const unsigned long long start = t_ticks;
   cpu_error = NONE;
   cpu_8080();
-  if (int_int == 0) { int_data = 0xc7; }
-  const uint16_t t = t_ticks - start;
-  rt_ticks += t;
-  if (uartclk.add_ticks(t)) {
-    if (uart.clock()) {
-      int_data |= 0xd7;
-      int_int = 1;
-      //wprintw(msgWin,"UART interrupt\n");wrefresh(msgWin);
-    }
+  // Halted: nothing happens before the next event, go straight there
+  if (cpu_halt && !int_int && cpu_state != STOPPED)
+    t_ticks = std::max(t_ticks, events.next_deadline());
+  runEvents();
+  rt_ticks += t_ticks - start;
+}
+
+// Run the CPU until the earliest pending device event, then handle every
+// event that has fallen due. The keyboard and NVR are also brought up to
+// date lazily whenever the firmware touches their ports, so they only
+// need an event when the keyboard is about to interrupt.
+void Vt100Sim::runSlice()
+{
+  const unsigned long long start = t_ticks;
+  t_limit = std::max(events.next_deadline(), start + 1);
+  cpu_error = NONE;
+  cpu_state = CONTIN_RUN;
+  cpu_8080();
+  if (cpu_state == CONTIN_RUN) cpu_state = SINGLE_STEP;
+  runEvents();
+  rt_ticks += t_ticks - start;
+}
+
+// Run the given number of CPU cycles as fast as possible, without
+// breakpoints or screen updates, and return the instructions executed.
+long Vt100Sim::bench(unsigned long long cycles)
+{
+  const unsigned long long end = t_ticks + cycles;
+  const long start = R;
+  while (t_ticks < end && cpu_error == NONE) {
+    runSlice();
   }
-  if (dc12 && lba4.add_ticks(t)) {
-    if (kbd.clock(lba4.get_value())) {
-      int_data |= 0xcf;
-      int_int = 1;
-      //wprintw(msgWin,"KBD interrupt\n");wrefresh(msgWin);
+  return R - start;
+}
+
+// Fast-forward through the polling loops the firmware idles in. The
+// probe holds the CPU state at an IN. When that IN comes round again
+// with the same registers, the same RAM, no OUT done and no interrupt
+// raised, the loop made an iteration that depended on nothing but the
+// values its INs read. As long as those values cannot
+// change (inStableUntil()) and no event is due, every further iteration
+// is the same, so whole iterations are skipped by advancing t_ticks and
+// R. The keyboard is clocked lazily, but its interrupts are events too.
+void Vt100Sim::idleCheck(BYTE port)
+{
+  const unsigned long long IDLE_WINDOW = 20000;	// longest loop looked for
+  const uint16_t pc = PC - ram - 2;	// PC is past the IN and its port
+  const BYTE mask = ram[(uint16_t)(pc + 2)] == 0xe6 ?	// ANI n
+    ram[(uint16_t)(pc + 3)] : 0xff;
+
+  if (cpu_state != CONTIN_RUN || int_int || brk_on) {	// keep hits exact
+    idle.valid = false;
+    return;
+  }
+  if (idle.valid && idle.pc == pc && ramRestored() &&
+      idle.a == A && idle.b == B && idle.c == C && idle.d == D &&
+      idle.e == E && idle.h == H && idle.l == L && idle.f == F &&
+      idle.sp == STACK && idle.iff == IFF &&
+      idle.protection == int_protection) {
+    const unsigned long long period = t_ticks - idle.ticks;
+    const unsigned long long limit = std::min(idle.stable, t_limit);
+    if (t_ticks + period < limit) {
+      const unsigned long long n = (limit - 1 - t_ticks) / period;
+      R += n * (R - idle.r);
+      t_ticks += n * period;
+      idle_skipped += n * period;
     }
+  } else if (idle.valid && t_ticks - idle.ticks < IDLE_WINDOW) {
+    idle.stable = std::min(idle.stable, inStableUntil(port, mask));
+    return;
   }
-  if (dc12 && lba7.add_ticks(t)) {
-    nvr.clock(lba7.get_value());
+  idle.valid = true;
+  idle.pc = pc;
+  idle.a = A; idle.b = B; idle.c = C; idle.d = D;
+  idle.e = E; idle.h = H; idle.l = L; idle.f = F;
+  idle.sp = STACK; idle.iff = IFF; idle.protection = int_protection;
+  idle.r = R;
+  idle.ticks = t_ticks;
+  idle.stable = inStableUntil(port, mask);
+  mem_logged = 0;
+}
+
+// True if every byte changed since the probe was taken is back to the
+// value it had then. The CALLs of a polling loop rewrite the stack.
+bool Vt100Sim::ramRestored()
+{
+  if (mem_logged > MEMLOG) return false;
+  for (int i = 0; i < mem_logged; i++) {
+    int first = 0;
+    while (mem_log[first] != mem_log[i]) first++;
+    if (ram[mem_log[i]] != mem_log_old[first]) return false;
+  }
+  return true;
+}
+
+// First cycle at which IN port, ANDed with mask, may read differently
+// than now, not counting changes by OUT or scheduled events. The
+// firmware masks the flag buffer, so LBA7, the 30Hz bit and the
+// keyboard buffer only count when it looks at them. The keyboard latch
+// only changes with a keyboard interrupt.
+unsigned long long Vt100Sim::inStableUntil(BYTE port, BYTE mask)
+{
+  unsigned long long until = ~0ULL;
+  switch (port) {
+  case 0x00:			// reading the data clears RxRDY
+    return t_ticks;
+  case 0x42:
+    if ((mask & 0x20) && !nvr.idle()) return t_ticks;
+    if ((mask & 0x01) && !uart.xmit_ready(t_ticks))
+      until = std::min(until, std::max(t_ticks, uart.xmit_ready_at()));
+    if ((mask & 0x80) && kbd.clocks_to_tx_empty())
+      until = std::min(until, lba4.next_rising(synced_ticks, kbd.clocks_to_tx_empty()));
+    if (mask & 0x40) until = std::min(until, lba7.next_change(t_ticks));
+    if (mask & 0x10) until = std::min(until, (t_ticks / 46084 + 1) * 46084);
+    return until;
+  default:			// PUSART status, keyboard latch, nothing
+    return until;
   }
-  if (dc12 && vertical.add_ticks(t)) {
-    if (vertical.get_value()) {
+}
+
+// Add or move an event; a running slice is cut short if it is sooner.
+void Vt100Sim::schedule(int event, unsigned long long when)
+{
+  events.schedule(event, when);
+  if (when < t_limit) t_limit = when;
+}
+
+void Vt100Sim::scheduleKbd()
+{
+  const uint32_t clocks = kbd.clocks_to_interrupt();
+  if (clocks)
+    schedule(EV_KBD, lba4.next_rising(synced_ticks, clocks));
+  else
+    events.cancel(EV_KBD);
+}
+
+void Vt100Sim::runEvents()
+{
+  int event;
+  syncDevices();
+  while ((event = events.pop_due(t_ticks)) != -1) {
+    switch (event) {
+    case EV_KBD:
+      // syncDevices() has already clocked it
+      scheduleKbd();
+      break;
+    case EV_UART:
+      if (uart.clock()) {
+	int_data |= 0xd7;
+	int_int = 1;
+	idle.valid = false;
+	//simLog("UART interrupt\n");
+      }
+      {
+	// A character a character time, or polls while unthrottled
+	const unsigned long period = uart.rx_time() ? uart.rx_time() : UART_PERIOD;
+	schedule(EV_UART, t_ticks - t_ticks % period + period);
+      }
+      break;
+    case EV_VERTICAL:
       int_data |= 0xe7;
       int_int = 1;
+      idle.valid = false;
       vscan_tick++;
+      uart.flush();
+      schedule(EV_VERTICAL, vertical.next_rising(t_ticks));
+      break;
     }
   }
-  needsUpdate = true;
 }
 
+// Catch the LBA4 and LBA7 clocked devices up with t_ticks, feeding them
+// every rising edge since the last call.
+void Vt100Sim::syncDevices()
+{
+  if (int_int == 0) { int_data = 0xc7; }
+  if (!dc12) {
+    synced_ticks = t_ticks;
+    return;
+  }
+  if (!kbd.idle()) {
+    unsigned long long n = lba4.rising_upto(t_ticks) - lba4.rising_upto(synced_ticks);
+    for (; n && !kbd.idle(); n--) {
+      if (kbd.clock(true)) {
+	int_data |= 0xcf;
+	int_int = 1;
+	idle.valid = false;
+	//simLog("KBD interrupt\n");
+      }
+    }
+  }
+  if (!nvr.idle()) {
+    unsigned long long n = lba7.rising_upto(t_ticks) - lba7.rising_upto(synced_ticks);
+    for (; n; n--) {
+      nvr.clock(true);
+    }
+  }
+  synced_ticks = t_ticks;
+}
+
+// Draw the frame taken last, see takeFrame()
 void Vt100Sim::update() {
-  needsUpdate = false;
+  flushLog();
   dispRegisters();
   dispMemory();
   dispVideo();
@@ -646,123 +1070,370 @@ void Vt100Sim::keypress(uint8_t keycode)
     kbd.keypress(keycode);
 }
 
+// Press the key that types ch, a character or a curses KEY_ code, with
+// Control and Shift as needed. False if there is no such key. KEYCODE
+// with a keycode presses that key, with Shift if 0x80 is set.
+bool Vt100Sim::pressKey(int ch)
+{
+    if (ch & KEYCODE) {
+      if (ch & 0x80) keypress(0x7d);	// Shift Key
+      if (ch & 0x7f) keypress(ch & 0x7f);
+      return true;
+    }
+    uint8_t kc = code[ch];
+    if (kc == 0 && ch >= 0 && ch < 32) {
+	kc = code[ch+'`'];
+	if (kc) {
+	  //simLog("KC=7c (Control)\n");
+	  keypress(0x7c);	// Control Key
+	}
+    }
+    if (kc & 0x80) {
+      //simLog("KC=7d (Shift)\n");
+      keypress(0x7d);	// Shift Key
+      kc &= 0x7f;
+    }
+    //simLog("KC=%02x < %02x\n", kc, ch);
+    if (kc)
+      keypress(kc);
+    return kc != 0;
+}
+
+// Breakpoints are flagged in brk_map[], so the cores can stop at them
+// at the cost of one load per opcode. The rest lives in breakpoints.
 void Vt100Sim::clearBP(uint16_t bp)
 {
-  breakpoints.erase(bp);
+  if (breakpoints.erase(bp)) {
+    brk_map[bp] &= ~BRK_EXEC;
+    brk_on--;
+  }
 }
 
 void Vt100Sim::addBP(uint16_t bp)
 {
-  breakpoints.insert(bp);
+  Breakpoint b = { -1, 0, 0, 0 };
+  clearBP(bp);
+  breakpoints[bp] = b;
+  brk_map[bp] |= BRK_EXEC;
+  brk_on++;
+}
+
+static const char* const bp_regs[] = {
+  "A", "B", "C", "D", "E", "H", "L", "F", "BC", "DE", "HL", "SP", 0
+};
+
+// Add a breakpoint given as "addr [reg=value] [#hits]", all numbers
+// in hex but the hits: it stops when reg holds value, from the given
+// hit on.
+bool Vt100Sim::addBP(const char* spec)
+{
+  char addr[5], reg[3];
+  const char* p = spec;
+  int n;
+  uint16_t bp;
+  Breakpoint b = { -1, 0, 0, 0 };
+
+  if (sscanf(p, " %4[0-9a-fA-F]%n", addr, &n) != 1 || !hexParse(addr, 4, bp))
+    return false;
+  p += n;
+  if (sscanf(p, " %2[A-Za-z] = %hx%n", reg, &b.value, &n) == 2) {
+    for (b.reg = 0; bp_regs[b.reg] && strcasecmp(reg, bp_regs[b.reg]); b.reg++)
+      ;
+    if (!bp_regs[b.reg]) return false;
+    p += n;
+  }
+  if (sscanf(p, " #%lu%n", &b.after, &n) == 1)
+    p += n;
+  if (sscanf(p, " %1s", reg) == 1)	// anything left over
+    return false;
+  addBP(bp);
+  breakpoints[bp] = b;
+  return true;
+}
+
+// Watchpoints mark their page in mem_page[], so only the stores to
+// that page pass memHook(). The kind the page had comes back with its
+// last watchpoint; ROM stays read only while watched.
+void Vt100Sim::addWatch(uint16_t addr)
+{
+  Breakpoint b = { -1, 0, 0, 0 };
+  if (watchpoints.count(addr) == 0) brk_on++;
+  watchpoints[addr] = b;
+  uint8_t page = addr >> 8;
+  if (watched_pages.count(page)) return;
+  BYTE kind = mem_page[page];
+  watched_pages[page] = kind;
+  if (kind == MEM_ROM)
+    mem_page[page] = MEM_ROM_WATCH;
+  else if (kind == MEM_RAM)
+    mem_page[page] = MEM_WATCH;	// MMIO is shown memHook() anyway
+}
+
+void Vt100Sim::clearWatch(uint16_t addr)
+{
+  if (!watchpoints.erase(addr)) return;
+  brk_on--;
+  std::map<uint16_t, Breakpoint>::iterator i =
+    watchpoints.lower_bound(addr & 0xff00);
+  if (i == watchpoints.end() || (i->first >> 8) != (addr >> 8)) {
+    uint8_t page = addr >> 8;		// last one in the page
+    mem_page[page] = watched_pages[page];
+    watched_pages.erase(page);
+  }
 }
 
 void Vt100Sim::clearAllBPs()
 {
-  breakpoints.clear();
+  while (!breakpoints.empty())
+    clearBP(breakpoints.begin()->first);
+  while (!watchpoints.empty())
+    clearWatch(watchpoints.begin()->first);
+}
+
+// A store to a watched page: stop after this opcode if it changes a
+// watched byte.
+void Vt100Sim::memHook(uint16_t addr, BYTE data)
+{
+  std::map<uint16_t, Breakpoint>::iterator i = watchpoints.find(addr);
+  if (i == watchpoints.end() || ram[addr] == data) return;
+  i->second.hits++;
+  watch_hit = true;
+  cpu_state = SINGLE_STEP;
+}
+
+// PC is at the breakpoint bp: count the hit and tell if it stops there
+bool Vt100Sim::hitBP(Breakpoint& bp)
+{
+  BYTE* const regs[] = { &A, &B, &C, &D, &E, &H, &L };
+  if (bp.reg >= 0) {
+    uint16_t v;
+    if (bp.reg < 7) v = *regs[bp.reg];
+    else if (bp.reg == 7) v = F;
+    else if (bp.reg == 11) v = STACK - ram;
+    else v = *regs[(bp.reg - 8) * 2 + 1] << 8 | *regs[(bp.reg - 8) * 2 + 2];
+    if (v != bp.value) return false;
+  }
+  return ++bp.hits >= bp.after;
+}
+
+// Switch the execution history on with room for (at least) the given
+// number of opcodes, or off with 0. The ring is one block, a power of
+// 2 long, so that the cores wrap it with a mask.
+bool Vt100Sim::setHistory(unsigned long entries)
+{
+  unsigned long n = 1;
+  struct history* h = NULL;
+  while (n < entries) n <<= 1;
+  if (entries > 0 && (n < entries ||
+      (h = (struct history*)calloc(n, sizeof(struct history))) == NULL))
+    return false;
+  free(his);
+  his = h;
+  h_mask = n - 1;
+  h_next = 0;
+  return true;
+}
+
+// Write the history to fn, oldest opcode first
+bool Vt100Sim::saveHistory(const char* fn)
+{
+  FILE* fp;
+  if (his == NULL || (fp = fopen(fn, "w")) == NULL) return false;
+  unsigned long i = h_next > h_mask ? h_next - h_mask - 1 : 0;
+  for (; i < h_next; i++) {
+    struct history* hp = &his[i & h_mask];
+    fprintf(fp, "%04x AF %04x BC %04x DE %04x HL %04x SP %04x\n", hp->h_adr,
+	    hp->h_af, hp->h_bc, hp->h_de, hp->h_hl, hp->h_sp);
+  }
+  return fclose(fp) == 0;
 }
 
+
 void Vt100Sim::dispRegisters() {
-  mvwprintw(regWin,1,1,"A %02x",A);
-  mvwprintw(regWin,2,1,"B %02x C %02x",B,C);
-  mvwprintw(regWin,3,1,"D %02x E %02x",D,E);
-  mvwprintw(regWin,4,1,"H %02x L %02x",H,L);
-  mvwprintw(regWin,5,1,"PC %04x",(PC-ram));
-  mvwprintw(regWin,6,1,"SP %04x",(STACK-ram));
+  const Frame& f = frames[frame_front];
+  mvwprintw(regWin,1,1,"A %02x",f.a);
+  mvwprintw(regWin,2,1,"B %02x C %02x",f.b,f.c);
+  mvwprintw(regWin,3,1,"D %02x E %02x",f.d,f.e);
+  mvwprintw(regWin,4,1,"H %02x L %02x",f.h,f.l);
+  mvwprintw(regWin,5,1,"PC %04x",f.pc);
+  mvwprintw(regWin,6,1,"SP %04x",f.sp);
   wrefresh(regWin);
 }
 
-void Vt100Sim::dispVideo() {
+// Read the screen from the display list in ram[] as the video
+// processor would show it: the rows after the two fill lines the
+// firmware starts the list with, at most max of them.
+int Vt100Sim::readScreen(ScreenLine* lines, int max)
+{
   uint16_t start = 0x2000;
-  int my,mx;
   int lattr = 3;
   int inscroll = 0;
-  getmaxyx(vidWin,my,mx);
-  werase(vidWin);
-  wattron(vidWin,COLOR_PAIR(4));
-  uint8_t y = -2;
-  for (uint8_t i = 1; i < 27; i++) {
-        char* p = (char*)ram + start;
-        char* maxp = p + 133;
-	//if (*p != 0x7f) y++;
-	y++;
-	wmove(vidWin,y,(mx>=134));
-	if (scroll_latch) {
-	    if (inscroll)
-		wattron(vidWin,COLOR_PAIR(1));
-	    else
-		wattron(vidWin,COLOR_PAIR(4));
-	}
-        while (*p != 0x7f && p != maxp) {
-            unsigned char c = *p;
-	    int attrs = enable_avo?p[0x1000]:0xF;
-	    p++;
-	    if (y > 0) {
-	      bool inverse = (c & 128);
-	      bool blink = !(attrs & 0x1);
-	      bool uline = !(attrs & 0x2);
-	      bool bold = !(attrs & 0x4);
-	      bool altchar = !(attrs & 0x8);
-	      c &= 0x7F;
-
-	      if (screen_rev) inverse = ~inverse;
-
-	      if (inverse) wattron(vidWin,A_REVERSE);
-	      if (uline) wattron(vidWin,A_UNDERLINE);
-	      if (blink) wattron(vidWin,A_BLINK);
-	      if (bold) wattron(vidWin,A_BOLD);
-
-	      if (c == 0 || c == 127) {
-		waddch(vidWin,' ');
-	      } else  {
-#ifdef _XOPEN_CURSES
-extern int utf8_term;
-static int xterm_chars[] = {
+  int n = 0;
+  for (int i = 1; i < 27; i++) {
+    const uint8_t* p = ram + start;
+    const uint8_t* maxp = p + ScreenLine::MAXLEN;
+    ScreenLine* l = NULL;
+    if (i > 2 && n < max) {
+      l = &lines[n++];
+      l->lattr = lattr;
+      l->inscroll = inscroll;
+      l->len = 0;
+    }
+    while (*p != 0x7f && p != maxp) {
+      if (l) {
+	l->ch[l->len] = *p;
+	l->attr[l->len++] = enable_avo?p[0x1000]:0xF;
+      }
+      p++;
+    }
+    if (p == maxp) {
+      //simLog("Overflow line %d\n",i);
+      break;
+    }
+    // at terminator
+    p++;
+    unsigned char a1 = *(p++);
+    unsigned char a2 = *(p++);
+    //printf("Next: %02x %02x\n",a1,a2);fflush(stdout);
+    uint16_t next = (((a1&0x10)!=0)?0x2000:0x4000) | ((a1&0x0f)<<8) | a2;
+    lattr = ((a1 >> 5) & 0x3);
+    inscroll = ((a1 >> 7) & 0x1);
+    if (start == next) break;
+    start = next;
+  }
+  return n;
+}
+
+// Unicode of the VT100 special graphics, characters 1 to 31
+const int xterm_chars[32] = {
 	0x2666, 0x2592, 0x2409, 0x240c, 0x240d, 0x240a, 0x00b0, 0x00b1,
 	0x2424, 0x240b, 0x2518, 0x2510, 0x250c, 0x2514, 0x253c, 0x23ba,
 	0x23bb, 0x2500, 0x23bc, 0x23bd, 0x251c, 0x2524, 0x2534, 0x252c,
 	0x2502, 0x2264, 0x2265, 0x03c0, 0x2260, 0x00a3, 0x00b7, 0x0020
 	};
 
-		if ((c>=3 && c<=6) || (c<32 && utf8_term)) {
-		    wchar_t ubuf[2] = { xterm_chars[c-1], '\0' };
-		    waddwstr(vidWin,ubuf);
-		} else if (c < 32) { waddch(vidWin,NCURSES_ACS(0x5F+c));
-		} else if (altchar) {
-		    wchar_t ubuf[2] = { c+128, '\0' };
-		    waddwstr(vidWin,ubuf);
-		}
+extern int utf8_term;
+
+// What dispVideo() shows for each character, worked out once: 0 for a
+// special graphic drawn from the curses ACS set, else the character.
+#ifdef _XOPEN_CURSES
+typedef wchar_t glyph_t;
 #else
-		if (c < 32) { waddch(vidWin,NCURSES_ACS(0x5F+c)); }
+typedef char glyph_t;
+#endif
+static glyph_t glyphs[128];
+
+static void makeGlyphs()
+{
+  for (int c = 0; c < 128; c++) {
+    if (c == 0 || c == 127)
+      glyphs[c] = ' ';
+#ifdef _XOPEN_CURSES
+    else if ((c>=3 && c<=6) || (c<32 && utf8_term))
+      glyphs[c] = xterm_chars[c-1];
+#endif
+    else if (c < 32)
+      glyphs[c] = 0;
+    else
+      glyphs[c] = c;
+  }
+}
+
+// Draw a row of the screen at the cursor, each run of characters with
+// the same attributes in one call, reversed if the frame is in reverse
+// screen. Graphics from the ACS set end a run and go on their own.
+void Vt100Sim::drawLine(const ScreenLine& l, bool screen_rev) {
+  glyph_t run[2 * ScreenLine::MAXLEN];
+  int n = 0;
+  attr_t run_attr = A_NORMAL;
+  for (int x = 0; x <= l.len; x++) {
+    attr_t a = A_NORMAL;
+    glyph_t g = 0;
+    unsigned char c = 0;
+    if (x < l.len) {
+      c = l.ch[x];
+      int attrs = l.attr[x];
+      bool inverse = (c & 128);
+      bool altchar = !(attrs & 0x8);
+      c &= 0x7F;
+
+      if (screen_rev) inverse = !inverse;
+
+      if (inverse) a |= A_REVERSE;
+      if (!(attrs & 0x2)) a |= A_UNDERLINE;
+      if (!(attrs & 0x1)) a |= A_BLINK;
+      if (!(attrs & 0x4)) a |= A_BOLD;
+      g = glyphs[c];
+#ifdef _XOPEN_CURSES
+      if (altchar && c >= 32 && c != 127) g = c+128;
 #endif
-		else { waddch(vidWin,c); }
-	      }
-
-	      if (lattr!=3) waddch(vidWin,' ');
-	      if (inverse) wattroff(vidWin,A_REVERSE);
-	      if (uline) wattroff(vidWin,A_UNDERLINE);
-	      if (bold) wattroff(vidWin,A_BOLD);
-	      if (blink) wattroff(vidWin,A_BLINK);
-            }
-        }
-        if (p == maxp) {
-	  //wprintw(msgWin,"Overflow line %d\n",i); wrefresh(msgWin);
-	  break;
-	}
-        // at terminator
-        p++;
-        unsigned char a1 = *(p++);
-        unsigned char a2 = *(p++);
-        //printf("Next: %02x %02x\n",a1,a2);fflush(stdout);
-        uint16_t next = (((a1&0x10)!=0)?0x2000:0x4000) | ((a1&0x0f)<<8) | a2;
-	lattr = ((a1 >> 5) & 0x3);
-	inscroll = ((a1 >> 7) & 0x1);
-        if (start == next) break;
-        start = next;
     }
-  wattroff(vidWin,COLOR_PAIR(4));
+    if (n && (x == l.len || a != run_attr || g == 0)) {
+      wattron(vidWin,run_attr);
+#ifdef _XOPEN_CURSES
+      waddnwstr(vidWin,run,n);
+#else
+      waddnstr(vidWin,run,n);
+#endif
+      wattroff(vidWin,run_attr);
+      n = 0;
+    }
+    if (x == l.len) break;
+    if (g == 0) {
+      wattron(vidWin,a);
+      waddch(vidWin,NCURSES_ACS(0x5F+c));
+      if (l.lattr!=3) waddch(vidWin,' ');
+      wattroff(vidWin,a);
+      continue;
+    }
+    run_attr = a;
+    run[n++] = g;
+    if (l.lattr!=3) run[n++] = ' ';
+  }
+}
+
+static bool sameLine(const ScreenLine& a, const ScreenLine& b)
+{
+  return a.lattr == b.lattr && a.inscroll == b.inscroll && a.len == b.len &&
+    !memcmp(a.ch, b.ch, a.len) && !memcmp(a.attr, b.attr, a.len);
+}
+
+// Only the rows that differ from the last frame are drawn again. A
+// change of the window size, the scroll latch (which colours the
+// scrolling region) or reverse screen redraws them all.
+void Vt100Sim::dispVideo() {
+  const Frame& f = frames[frame_front];
+  const ScreenLine* lines = f.lines;
+  const int n = f.rows;
+  int my,mx;
+  getmaxyx(vidWin,my,mx);
+  if (mx != shown_cols || f.scroll_latch != shown_scroll ||
+      f.screen_rev != shown_rev) {
+    werase(vidWin);
+    shown_rows = 0;
+    shown_cols = mx;
+    shown_scroll = f.scroll_latch;
+    shown_rev = f.screen_rev;
+  }
+  for (int y = 1; y <= std::max(n, shown_rows) && y < my; y++) {
+	const ScreenLine& l = lines[y-1];
+	if (y <= n && y <= shown_rows && sameLine(l, shown[y-1]))
+	  continue;
+	wmove(vidWin,y,0);
+	wclrtoeol(vidWin);
+	if (y > n) continue;
+	wmove(vidWin,y,(mx>=134));
+	wattrset(vidWin,COLOR_PAIR(f.scroll_latch && l.inscroll ? 1 : 4));
+	drawLine(l, f.screen_rev);
+	shown[y-1] = l;
+  }
+  shown_rows = n;
+  wattrset(vidWin,A_NORMAL);
+  wmove(vidWin,0,0);
+  wclrtoeol(vidWin);
   if (mx>=134) box(vidWin,0,0);
-  mvwprintw(vidWin,0,1,"Video [bright %x]",bright);
-  if (scroll_latch) wprintw(vidWin,"[Scroll %d]",scroll_latch);
+  mvwprintw(vidWin,0,1,"Video [bright %x]",f.bright);
+  if (f.scroll_latch) wprintw(vidWin,"[Scroll %d]",f.scroll_latch);
   // if (blink_ff) wprintw(vidWin,"[BLINK]");
   wrefresh(vidWin);
 }
@@ -788,7 +1459,8 @@ void Vt100Sim::dispStatus() {
   int mx, my;
   getmaxyx(statusBar,my,mx);
   wmove(statusBar,0,mx-lwidth);
-  uint8_t flags = kbd.get_status();
+  const Frame& f = frames[frame_front];
+  uint8_t flags = f.kbd_status;
   displayFlag(ledNames[0], (flags & (1<<5)) == 0 );
   displayFlag(ledNames[1], (flags & (1<<5)) != 0 );
   displayFlag(ledNames[2], (flags & (1<<4)) != 0 );
@@ -810,35 +1482,40 @@ void Vt100Sim::dispStatus() {
     wprintw(statusBar," ");
   }
   wprintw(statusBar," | ");
-  if (running) {
+  if (f.running) {
     wprintw(statusBar,"RUNNING");
   } else {
     wattron(statusBar,A_REVERSE);
     wprintw(statusBar,"STOPPED");
     wattroff(statusBar,A_REVERSE);
   }
-  wprintw(statusBar," | %s |",uart.pty_name());
+  wprintw(statusBar," | %s |",f.pty);
   wrefresh(statusBar);
 }
 
 void Vt100Sim::dispBPs() {
-  int y = 1;
+  const Frame& f = frames[frame_front];
   werase(bpWin);
   box(bpWin,0,0);
   mvwprintw(bpWin,0,1,"Brkpts");
-  for (std::set<uint16_t>::iterator i = breakpoints.begin();
-       i != breakpoints.end();
-       i++) {
-    mvwprintw(bpWin,y++,2,"%04x",*i);
+  for (int i = 0; i < f.nbps; i++) {
+    if (f.bps[i].kind == 'W')
+      mvwprintw(bpWin,i+1,1,"W%04x %lu",f.bps[i].addr,f.bps[i].hits);
+    else
+      mvwprintw(bpWin,i+1,1,"%04x%c%lu",f.bps[i].addr,f.bps[i].kind,
+		f.bps[i].hits);
   }
   wrefresh(bpWin);
 }
 
 void Vt100Sim::snapMemory() {
-  memset(touched+0x2000,0,0x2000);
+#ifdef WANT_DIRTY
+  memset(dirty+0x2000/8,0,0x2000/8);
+#endif
 }
 
 void Vt100Sim::dispMemory() {
+  const Frame& f = frames[frame_front];
   int my,mx;
   getmaxyx(memWin,my,mx);
   int bavail = (mx - 7)/3;
@@ -852,18 +1529,21 @@ void Vt100Sim::dispMemory() {
   }
   wattrset(memWin,COLOR_PAIR(1));
 
-  for (int y = 1; y < my - 1; y++) {
+  for (int y = 1; y < my - 1 && start < 0x2000 + FRAME_MEM; y++) {
     wattrset(memWin,COLOR_PAIR(1));
     mvwprintw(memWin,y,1,"%04x:",start);
     for (int b = 0; b<bdisp;b++) {
-      if (!touched[start]) 
+      const int i = start++ - 0x2000;
+#ifdef WANT_DIRTY
+      if (!(f.dirty[i >> 3] & (1 << (i & 7))))
 	wattron(memWin,A_STANDOUT);
-      if (ram[start] != 00) {
+#endif
+      if (f.mem[i] != 00) {
 	wattron(memWin,COLOR_PAIR(2));
-	wprintw(memWin," %02x",ram[start++]);
+	wprintw(memWin," %02x",f.mem[i]);
 	wattron(memWin,COLOR_PAIR(1));
       } else {
-	wprintw(memWin," %02x",ram[start++]);
+	wprintw(memWin," %02x",f.mem[i]);
       }
       wattroff(memWin,A_STANDOUT);
     }
@@ -872,19 +1552,23 @@ void Vt100Sim::dispMemory() {
 }
 
 extern "C" {
-BYTE io_in(BYTE addr);
-void io_out(BYTE addr, BYTE data);
 void exit_io();
 }
 
 void exit_io() {}
 
-BYTE io_in(BYTE addr)
+// The devices of the machine, see struct cpu_io
+BYTE Vt100Sim::ioInCB(void* ctx, BYTE addr)
+{
+    return ((Vt100Sim*)ctx)->ioIn(addr);
+}
+
+void Vt100Sim::ioOutCB(void* ctx, BYTE addr, BYTE data)
 {
-    return sim->ioIn(addr);
+    ((Vt100Sim*)ctx)->ioOut(addr,data);
 }
 
-void io_out(BYTE addr, BYTE data)
+void Vt100Sim::memHookCB(void* ctx, WORD addr, BYTE data)
 {
-    sim->ioOut(addr,data);
+    ((Vt100Sim*)ctx)->memHook(addr,data);
 }
@@ -4,20 +4,50 @@
 #include "nvr.h"
 #include "keyboard.h"
 #include "pusart.h"
+#include "scheduler.h"
 #include <stdint.h>
 #include <set>
-#include <sys/time.h>
+#include <map>
+#include <time.h>
+#include <pthread.h>
 
 extern "C" {
 #include "8080/sim.h"
 }
 
+struct machine;
+
+// One row of the screen, see Vt100Sim::readScreen()
+struct ScreenLine {
+  static const int ROWS = 24;	// most rows shown
+  static const int MAXLEN = 133;
+  int lattr;			// line attributes, 3: single width
+  int inscroll;			// in the scrolling region
+  int len;
+  uint8_t ch[MAXLEN];		// bit 7: reverse video
+  uint8_t attr[MAXLEN];		// AVO attributes, active low: 1 blink,
+				// 2 underline, 4 bold, 8 alternate chars
+};
+
+// Unicode of the special graphics characters 1 to 31
+extern const int xterm_chars[32];
+
+typedef enum {
+    EV_KBD = 0,		// keyboard scan byte ready (LBA4)
+    EV_UART = 1,	// PUSART receive poll
+    EV_VERTICAL = 2,	// vertical retrace interrupt
+} SimEvent;
+
 class Vt100Sim
 {
 public:
-  Vt100Sim(const char* romPath = 0,bool running=false, bool avo_on=true);
+  Vt100Sim(const char* romPath = 0,bool running=false, bool avo_on=true, bool screen=true);
   ~Vt100Sim();
   void init();
+  // Make this the machine the calling thread runs; the constructor
+  // has done so already
+  void enter();
+  void leave();
   BYTE ioIn(BYTE addr);
   void ioOut(BYTE addr, BYTE data);
   NVR nvr;
@@ -26,31 +56,125 @@ public:
   uint8_t bright;
 private:
   const char* romPath;
+  struct machine* mach;		// CPU state and memory, see 8080/machine.h
+  static BYTE ioInCB(void* ctx, BYTE addr);
+  static void ioOutCB(void* ctx, BYTE addr, BYTE data);
+  static void memHookCB(void* ctx, WORD addr, BYTE data);
   bool running;
   bool inputMode;
-  bool needsUpdate;
-  std::set<uint16_t> breakpoints;
-  bool has_breakpoints;
+  // A breakpoint, or a watchpoint stopping when its byte changes
+  struct Breakpoint {
+    int reg;			// register of the condition, -1: none
+    uint16_t value;		// value the register must have
+    unsigned long hits;		// times reached with the condition true
+    unsigned long after;	// stop from this hit on
+  };
+  std::map<uint16_t, Breakpoint> breakpoints, watchpoints;
+  std::map<uint8_t, BYTE> watched_pages;	// kind each had before
+  bool watch_hit;		// a watched byte changed, stop
+  bool hitBP(Breakpoint& bp);
   bool dc12;
   bool controlMode;
   bool enable_avo;
+  bool screen;			// on the curses screen, else run by vt100farm
+				// or vt100headless
   long long rt_ticks;
-  struct timeval last_sync;
-  int vscan_tick, refresh_clock;
+  unsigned long long synced_ticks;
+  struct timespec last_sync;
+  int vscan_tick;
   int scroll_latch;
   int screen_rev;
   int base_attr;
   int blink_ff;
+  // What the curses screen shows of the machine. run() has the CPU
+  // thread publish one at every vertical retrace and when it stops,
+  // through a triple buffer: the CPU thread fills frames[frame_back]
+  // and swaps it with frame_mid, the screen draws frames[frame_front]
+  // and swaps that with frame_mid when a fresher frame is there.
+  static const int FRAME_MEM = 0x1000;	// bytes from 0x2000 shown
+  struct Frame {
+    ScreenLine lines[ScreenLine::ROWS];
+    int rows, scroll_latch, screen_rev, bright;
+    BYTE a, b, c, d, e, h, l;
+    uint16_t pc, sp;
+    BYTE mem[FRAME_MEM];
+    BYTE dirty[FRAME_MEM / 8];
+    uint8_t kbd_status;
+    bool running;
+    unsigned long stops;	// times stopped at a breakpoint
+    struct { char kind; uint16_t addr; unsigned long hits; } bps[16];
+    int nbps;
+    char pty[32];
+  };
+  Frame frames[3];
+  int frame_back, frame_front;
+  int frame_mid;		// index, FRAME_FRESH if not drawn yet
+  static const int FRAME_FRESH = 4;
+  unsigned long stops;
+  void publish();
+  bool takeFrame();
+  // Handing the machine between the CPU thread and the screen, see
+  // hold(); and the keys typed, on their way to the CPU thread
+  pthread_mutex_t hold_mutex;
+  pthread_cond_t hold_cond;
+  int hold_req;
+  bool cpu_held, quit;
+  int steps;
+  int typed[64];
+  unsigned typed_in, typed_out;
+  static void* cpuThreadCB(void* ctx);
+  void cpuThread();
+  void cpuPause();
+  void hold();
+  void release();
+  void type(int ch);
+  // The rows dispVideo() drew last, and what they were drawn for
+  ScreenLine shown[ScreenLine::ROWS];
+  int shown_rows, shown_cols, shown_scroll, shown_rev;
+  void drawLine(const ScreenLine& l, bool screen_rev);
+  Scheduler events;
+  // CPU state at an IN, to spot polling loops; see idleCheck()
+  struct IdleProbe {
+    bool valid;
+    uint16_t pc;
+    BYTE a, b, c, d, e, h, l, iff;
+    int f, protection;
+    BYTE *sp;
+    long r;
+    unsigned long long ticks, stable;
+  } idle;
+  bool idle_skip;
+  unsigned long long idle_skipped;
+  void idleCheck(BYTE port);
+  bool ramRestored();
+  unsigned long long inStableUntil(BYTE port, BYTE mask);
+  void schedule(int event, unsigned long long when);
+  void scheduleKbd();
+  void runEvents();
+  void syncDevices();
 public:
   void getString(const char* prompt, char* buffer, uint8_t sz);
   void step();
+  void runSlice();
   void run();
+  long bench(unsigned long long cycles);
+  void setIdleSkip(bool on) { idle_skip = on; idle.valid = false; }
+  unsigned long long idleSkipped() { return idle_skipped; }
   void keypress(uint8_t keycode);
+  static const int KEYCODE = 0x10000;	// for pressKey(): a keycode
+  bool pressKey(int ch);
   void clearBP(uint16_t bp);
   void addBP(uint16_t bp);
+  bool addBP(const char* spec);
+  void addWatch(uint16_t addr);
+  void clearWatch(uint16_t addr);
+  void memHook(uint16_t addr, BYTE data);
   void clearAllBPs();
+  bool setHistory(unsigned long entries);
+  bool saveHistory(const char* fn);
 public:
     void dispRegisters();
+    int readScreen(ScreenLine* lines, int max);
     void dispVideo();
     void dispLEDs();
     void dispStatus();